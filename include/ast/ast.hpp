@@ -6,6 +6,9 @@
 #include <memory>
 #include <vector>
 #include <iostream>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
 
 #define ACCESS_PRESEDENCDE 1
 #define LITERAL_PRESEDENCDE 1
@@ -27,7 +30,10 @@ class Identifier;
 class ClassAccess;
 class IndexAccess;
 class FunctionCall;
+class List;
+class Slice;
 class Return;
+class For;
 class Assign;
 class Block;
 class FunctionDefinition;
@@ -45,7 +51,10 @@ public:
     virtual void visit_class_access(ClassAccess &) {}
     virtual void visit_index_access(IndexAccess &) {}
     virtual void visit_function_call(FunctionCall &) {}
+    virtual void visit_list(List &) {}
+    virtual void visit_slice(Slice &) {}
     virtual void visit_return_stmt(Return &) {}
+    virtual void visit_for_stmt(For &) {}
     virtual void visit_assign_stmt(Assign &) {}
     virtual void visit_block_stmt(Block &) {}
     virtual void visit_function_definition(FunctionDefinition &) {}
@@ -175,9 +184,18 @@ public:
 class Number : public Literal {
 public:
     Number(const Token &token, TokenRange tokens, std::shared_ptr<Node> parent) : Literal(token, tokens, parent) {
-        number = std::stof(token.literal());
-    }
-    float number;
+        std::string literal = token.literal();
+        number = std::strtod(literal.c_str(), NULL);
+        /* literals without a fraction are exact, unless they overflow int64 */
+        errno = 0;
+        integer = std::strtoll(literal.c_str(), NULL, 10);
+        is_integer = literal.find('.') == std::string::npos and errno != ERANGE;
+    }
+    /* a number computed by the compiler, it keeps the first token of the expression it replaces */
+    Number(double number, int64_t integer, bool is_integer, TokenRange tokens, std::shared_ptr<Node> parent) : Literal(tokens.tokens->tokens[tokens.start], tokens, parent), number(number), integer(integer), is_integer(is_integer) {}
+    double number;
+    int64_t integer;
+    bool is_integer;
 
     void visit(Visitor &visitor) override {
         visitor.visit_number(*this);
@@ -290,6 +308,45 @@ private:
     FunctionCall(std::shared_ptr<Identifier> name, TokenRange tokens, std::shared_ptr<Node> parent, std::vector<std::shared_ptr<Expression>> parameters) : Access(tokens, parent), name(name), parameters(parameters) {}
 };
 
+/* list literal, [a, b, c] */
+class List : public Expression {
+public:
+    static std::shared_ptr<List> create(std::vector<std::shared_ptr<Expression>> elements, TokenRange tokens, std::shared_ptr<Node> parent);
+    std::vector<std::shared_ptr<Expression>> elements;
+
+    void visit(Visitor &visitor) override {
+        visitor.visit_list(*this);
+    }
+
+    std::shared_ptr<Node> get_left_child() override {
+        return NULL;
+    }
+    std::shared_ptr<Node> get_right_child() override {
+        return NULL;
+    }
+private:
+    List(std::vector<std::shared_ptr<Expression>> elements, TokenRange tokens, std::shared_ptr<Node> parent) : Expression(tokens, parent, LITERAL_PRESEDENCDE), elements(elements) {}
+};
+
+/* index of an IndexAccess that takes a slice, a[start:stop], omitted bounds are NULL */
+class Slice : public Expression {
+public:
+    static std::shared_ptr<Slice> create(std::shared_ptr<Expression> start, std::shared_ptr<Expression> stop, TokenRange tokens, std::shared_ptr<Node> parent);
+    std::shared_ptr<Expression> start, stop;
+
+    void visit(Visitor &visitor) override {
+        visitor.visit_slice(*this);
+    }
+
+    std::shared_ptr<Node> get_left_child() override {
+        return start;
+    }
+    std::shared_ptr<Node> get_right_child() override {
+        return stop;
+    }
+private:
+    Slice(std::shared_ptr<Expression> start, std::shared_ptr<Expression> stop, TokenRange tokens, std::shared_ptr<Node> parent) : Expression(tokens, parent, LITERAL_PRESEDENCDE), start(start), stop(stop) {}
+};
 
 class Return : public Statement {
 public:
@@ -343,6 +400,28 @@ private:
     Assign(std::shared_ptr<Access> location, std::shared_ptr<Expression> expr, std::shared_ptr<Node> parent, TokenRange tokens) : Statement(tokens, parent, STMT_PRESEDENCE), location(location), expr(expr) {}
 };
 
+/* for target in sequence: block */
+class For: public Statement {
+public:
+    static std::shared_ptr<For> create(std::shared_ptr<Access> target, std::shared_ptr<Expression> sequence, std::shared_ptr<Block> block, TokenRange tokens, std::shared_ptr<Node> parent);
+
+    std::shared_ptr<Access> target;
+    std::shared_ptr<Expression> sequence;
+    std::shared_ptr<Block> block;
+
+    std::shared_ptr<Node> get_left_child() override {
+        return target;
+    }
+    std::shared_ptr<Node> get_right_child() override {
+        return sequence;
+    }
+    void visit(Visitor &visitor) override {
+        visitor.visit_for_stmt(*this);
+    }
+private:
+    For(std::shared_ptr<Access> target, std::shared_ptr<Expression> sequence, std::shared_ptr<Block> block, TokenRange tokens, std::shared_ptr<Node> parent) : Statement(tokens, parent, STMT_PRESEDENCE), target(target), sequence(sequence), block(block) {}
+};
+
 class Block: public Statement {
 public:
     std::vector<std::shared_ptr<Statement>> statements;
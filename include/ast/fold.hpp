@@ -0,0 +1,59 @@
+#ifndef AST_FOLD_H
+#define AST_FOLD_H
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ast/ast.hpp"
+
+namespace ast {
+
+/*
+ * Simplifies the tree before it is compiled:
+ *   - arithmetic on number literals, including unary minus, is computed
+ *     with the same int/double rules the interpreter uses
+ *   - x * 1, 1 * x and x - 0 become x when x is known to be a number
+ *   - a local assigned a constant exactly once, outside of any loop, is
+ *     replaced by the constant wherever it is read after the assignment
+ *
+ * Every function, method and the root scope are simplified on their own,
+ * since they do not share locals.
+ */
+class ConstantFolder : public Visitor {
+public:
+    void visit_binary_op(BinaryOp &) override;
+    void visit_unary_op(UnaryOp &) override;
+    void visit_identifier(Identifier &) override;
+    void visit_class_access(ClassAccess &) override;
+    void visit_index_access(IndexAccess &) override;
+    void visit_function_call(FunctionCall &) override;
+    void visit_list(List &) override;
+    void visit_return_stmt(Return &) override;
+    void visit_assign_stmt(Assign &) override;
+    void visit_for_stmt(For &) override;
+    void visit_block_stmt(Block &) override;
+    void visit_function_definition(FunctionDefinition &) override;
+    void visit_method_definition(MethodDefinition &) override;
+    void visit_class_definition(ClassDefinition &) override;
+    void visit_file(File &) override;
+
+private:
+    /* the simplified expression, or expression itself if nothing changed */
+    std::shared_ptr<Expression> fold(std::shared_ptr<Expression> expression);
+    /* simplifies inside a node that is kept, like an access chain */
+    void walk(std::shared_ptr<Node> node);
+    void fold_scope(std::shared_ptr<Block> block, const std::vector<std::shared_ptr<Identifier>> &parameters);
+    /* set by a visit that replaces its node */
+    std::shared_ptr<Expression> replacement;
+    /* locals of the current scope known to hold a constant */
+    std::unordered_map<Symbol, std::shared_ptr<Number>> constants;
+    /* number of assignments to each local of the current scope */
+    std::unordered_map<Symbol, size_t> assignments;
+    std::unordered_set<Symbol> parameters;
+    unsigned int loop_depth = 0;
+};
+
+}
+
+#endif
@@ -30,6 +30,9 @@ public:
     void visit_class_access(ClassAccess &node) override;
     void visit_index_access(IndexAccess &node) override;
     void visit_function_call(FunctionCall &node) override;
+    void visit_list(List &node) override;
+    void visit_slice(Slice &node) override;
+    void visit_for_stmt(For &node) override;
     void visit_return_stmt(Return &node) override;
     void visit_assign_stmt(Assign &node) override;
     void visit_block_stmt(ast::Block &) override;
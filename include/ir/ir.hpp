@@ -0,0 +1,184 @@
+#ifndef IR_H
+#define IR_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "runtime/code.hpp"
+
+namespace ir {
+
+/*
+ * What a value is known to be. Number is an int or a double, Any is
+ * everything including Void.
+ */
+enum class Type {
+    Void,
+    Int,
+    Double,
+    Number,
+    String,
+    List,
+    Array,
+    Object,
+    Any,
+};
+
+const char *type_name(Type type);
+/* the least type covering both */
+Type join(Type a, Type b);
+
+/* operands are in the order the bytecode pushes them */
+enum class Op {
+    Const,          // <constant>
+    Param,          // <slot>  argument passed in the frame
+    Phi,            // one operand per predecessor, in order
+    Copy,           // value stored to a variable, the hint names it
+    Add,
+    Minus,
+    Divide,
+    Multiply,
+    Negate,
+    LoadAttribute,  // <name>  object
+    StoreAttribute, // <name>  value, object
+    IndexLoad,      // sequence, index
+    IndexStore,     // value, sequence, index
+    BuildList,      // elements
+    Slice,          // <bounds>  sequence, start if given, stop if given
+    CallFunction,   // <function>  arguments
+    CallMethod,     // <name>  receiver, arguments
+    CallConstructor,// <class>  arguments
+    CallBuiltin,    // <builtin>  arguments
+    GetIterator,    // sequence, the loop state is kept on the operand stack
+    IterValue,      // element pushed by the ForIter of the block before
+    /* terminators, the last instruction of every block */
+    Jump,           // successor: target
+    ForIter,        // successors: body, exit
+    Return,         // value
+    ReturnVoid,
+    TailCallFunction, // <function>  arguments
+    TailCallMethod,   // <name>  receiver, arguments
+    NumOps
+};
+
+struct OpInfo {
+    const char *name;
+    bool has_result;
+    /* can be removed if unused or merged with an equal instruction, given numeric operands for arithmetic */
+    bool pure;
+    bool terminator;
+};
+
+extern const OpInfo op_info[static_cast<size_t>(Op::NumOps)];
+
+inline const OpInfo &info(Op op) {
+    return op_info[static_cast<size_t>(op)];
+}
+
+class Block;
+
+/* no variable slot */
+#define NO_SLOT UINT32_MAX
+
+class Instruction {
+public:
+    Op op;
+    Type type;
+    std::vector<Instruction *> operands;
+    /* meaning depends on op, see the comments of Op */
+    uint32_t immediate;
+    /* the variable this value was stored to, lowering prefers its slot */
+    uint32_t hint;
+    Block *block;
+    unsigned int id;
+    /* set by passes, removed by Graph::sweep() */
+    bool dead;
+
+    Instruction(Op op, Type type, std::vector<Instruction *> operands, uint32_t immediate, Block *block, unsigned int id)
+        : op(op), type(type), operands(operands), immediate(immediate), hint(NO_SLOT), block(block), id(id), dead(false) {}
+
+    bool has_result() const {
+        return info(op).has_result;
+    }
+    bool is_terminator() const {
+        return info(op).terminator;
+    }
+    /* has no effect besides its result, so it may be removed or merged */
+    bool is_pure() const;
+};
+
+class Block {
+public:
+    unsigned int id;
+    std::vector<Instruction *> phis;
+    /* the last one is the terminator */
+    std::vector<Instruction *> instructions;
+    std::vector<Block *> predecessors;
+    /* Jump: target, ForIter: body then exit */
+    std::vector<Block *> successors;
+
+    Block(unsigned int id) : id(id) {}
+    Instruction *terminator() {
+        return instructions.back();
+    }
+};
+
+/*
+ * SSA form of one code object. Every value is defined once by an
+ * instruction, variables of the bytecode only remain as hints. Blocks are
+ * kept in bytecode order: loops jump back to their ForIter and leave it
+ * forwards, so the blocks are ordered such that all predecessors come first
+ * except for those jumping back. Whatever is left on the operand stack at
+ * the end of a block is the state of the enclosing loops.
+ */
+class Graph {
+public:
+    runtime::Code &code;
+    std::vector<std::unique_ptr<Block>> blocks;
+
+    Graph(runtime::Code &code) : code(code), next_id(0) {}
+
+    Block *entry() {
+        return blocks.front().get();
+    }
+    Block *create_block();
+    /* appends to block before its terminator, or at its end while it has none */
+    Instruction *create(Block *block, Op op, Type type, std::vector<Instruction *> operands, uint32_t immediate = 0);
+    Instruction *create_phi(Block *block, Type type);
+    /* the instruction pushing constant, placed at the start of the entry block */
+    Instruction *constant(runtime::Operand constant);
+    void replace_all_uses(Instruction *old_value, Instruction *new_value);
+    /* replaces every operand with its entry in replacements, by id, unless that is NULL */
+    void replace_uses(const std::vector<Instruction *> &replacements);
+    /* number of operands referring to each instruction, by id */
+    std::vector<unsigned int> count_uses();
+    /* drops instructions marked dead */
+    void sweep();
+    unsigned int num_ids() const {
+        return next_id;
+    }
+    void print();
+
+private:
+    std::vector<std::unique_ptr<Instruction>> pool;
+    std::vector<Instruction *> constants;
+    unsigned int next_id;
+};
+
+/* the type of constant in code's pool */
+Type constant_type(runtime::Value constant);
+/* the type the instruction computes from its operand types */
+Type infer_type(const Instruction &instruction);
+/* recomputes the types of all instructions computed from their operands */
+void infer_types(Graph &graph);
+
+/* the SSA form of code, NULL if its bytecode has a shape the builder does not handle */
+std::unique_ptr<Graph> build(runtime::Code &code);
+/* replaces the bytecode of graph.code with the lowered graph */
+void lower(Graph &graph, bool superinstructions);
+
+}
+
+#endif
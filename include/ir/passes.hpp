@@ -0,0 +1,146 @@
+#ifndef IR_PASSES_H
+#define IR_PASSES_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ir/ir.hpp"
+
+namespace ir {
+
+/* instructions a callee may have, besides constants, parameters and its return, to be inlined */
+#define INLINE_MAX_SIZE 10
+/* instructions inlining may add to one caller */
+#define INLINE_MAX_GROWTH 400
+
+class PassManager;
+
+class Pass {
+public:
+    virtual ~Pass() {}
+    /* how --dump-ir refers to the pass */
+    virtual const char *name() = 0;
+    virtual void run(Graph &graph) = 0;
+};
+
+/*
+ * Replaces calls of small functions, and of methods on receivers whose
+ * class is known, with a copy of the callee's body. The receiver class is
+ * known for the result of a constructor and for self. Callees must be a
+ * single block without loops and must not call themselves, tail calls stay
+ * tail calls. The callee's graph is copied as the pass manager left it.
+ */
+class Inliner : public Pass {
+public:
+    Inliner(PassManager &manager) : manager(manager) {}
+    const char *name() override {
+        return "inline";
+    }
+    void run(Graph &graph) override;
+
+private:
+    PassManager &manager;
+    Graph *inlinable(Graph &graph, Instruction *call);
+};
+
+/*
+ * Uses the stored value wherever a variable is read, and drops phis that
+ * merge a single value. The value takes over the variable as its hint.
+ */
+class CopyPropagation : public Pass {
+public:
+    const char *name() override {
+        return "copy-propagation";
+    }
+    void run(Graph &graph) override;
+};
+
+/* removes pure instructions whose result is never used, also cycles of phis */
+class DeadCodeElimination : public Pass {
+public:
+    const char *name() override {
+        return "dead-code";
+    }
+    void run(Graph &graph) override;
+};
+
+/*
+ * Reuses arithmetic computed before on the same operands, where the
+ * earlier one dominates. A repeated computation that fails reports its
+ * error only once.
+ */
+class CommonSubexpressionElimination : public Pass {
+public:
+    const char *name() override {
+        return "common-subexpressions";
+    }
+    void run(Graph &graph) override;
+};
+
+/*
+ * Reuses an attribute loaded or stored before on the same object, like
+ * self.x read again and again in a method. A store to an attribute of the
+ * same name on any object, or a call, may change it, and a loop header
+ * starts over.
+ */
+class RedundantLoadElimination : public Pass {
+public:
+    const char *name() override {
+        return "redundant-loads";
+    }
+    void run(Graph &graph) override;
+};
+
+/*
+ * Keeps the attributes of objects that never leave the code creating them
+ * in SSA values instead of allocating the object. An object qualifies if
+ * its constructor is small enough to be inlined and only loads and stores
+ * its attributes, and the code only loads and stores them too, after
+ * inlining its method calls. Attributes never stored read as Void.
+ */
+class ScalarReplacement : public Pass {
+public:
+    ScalarReplacement(PassManager &manager) : manager(manager) {}
+    const char *name() override {
+        return "scalar-replacement";
+    }
+    void run(Graph &graph) override;
+
+private:
+    PassManager &manager;
+    Graph *replaceable(Graph &graph, Instruction *object, const std::vector<bool> &escapes);
+};
+
+/*
+ * Runs the passes of an optimization level on the SSA form of the code
+ * objects of a program and lowers them back into bytecode:
+ *   -O0  nothing, the bytecode is used as compiled
+ *   -O1  inlining, copy propagation, scalar replacement and dead code
+ *        elimination
+ *   -O2  also redundant load and common subexpression elimination
+ */
+class PassManager {
+public:
+    PassManager(int level);
+    void add(std::unique_ptr<Pass> pass);
+    /*
+     * replaces the bytecode of codes, in order, so callees should come
+     * first. Code that cannot be built stays as it is.
+     */
+    void run(const std::vector<runtime::Code *> &codes, bool superinstructions);
+    /* the graph of code while running, NULL if it has none */
+    Graph *graph(runtime::Code &code);
+    /* prints the graph after the pass of this name, "build" before the first and "all" after each */
+    std::string dump;
+
+private:
+    std::vector<std::unique_ptr<Pass>> passes;
+    std::unordered_map<runtime::Code *, std::unique_ptr<Graph>> graphs;
+    void print(Graph &graph, const char *stage);
+};
+
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/*
+ * Identifiers are interned once while lexing. Every later stage names
+ * variables, functions, classes and attributes by their Symbol, a dense
+ * index, so comparing or hashing a name never touches its characters.
+ */
+using Symbol = uint32_t;
+
+class SymbolTable {
+public:
+    static SymbolTable &global();
+
+    Symbol intern(std::string_view name);
+    const std::string &name(Symbol symbol) const {
+        return names[symbol];
+    }
+private:
+    SymbolTable() = default;
+    /* a deque never moves its strings, so the views below stay valid */
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, Symbol> symbols;
+};
+
+inline const std::string &symbol_name(Symbol symbol) {
+    return SymbolTable::global().name(symbol);
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define TOKENS_H
 
 #include "location.hpp"
+#include "symbol.hpp"
 #include <string>
 #include <vector>
 #include <memory>
@@ -17,11 +18,15 @@ public:
         Newline, // \n
         Word, // Every keyword or identifier
     };
-    Token(Type type, Range location, std::shared_ptr<std::string> code_string) : type(type), location(location), code_string(code_string) {}
+    Token(Type type, Range location, std::shared_ptr<std::string> code_string) : type(type), location(location), symbol(0), code_string(code_string) {}
     Type type;
     std::string literal() const;
+    /* the literal without copying it out of the source */
+    std::string_view view() const;
     void print();
     Range location;
+    /* interned literal of Word tokens */
+    Symbol symbol;
 private:
     std::map<Type, std::string> type_strings = {
         {Type::String, "string"},
@@ -7,13 +7,14 @@
 #include <memory>
 
 /*
- * Statement        = IdentifierAcess = Expression | return Expression
+ * Statement        = IdentifierAcess = Expression | return Expression | for IdentifierAccess in Expression: Block
  * Expression       = Factor | Factor + Expression | Factor - Expression
  * Factor           = UnaryOp | UnaryOp * Factor | UnaryOp / Factor
  * UnaryOp          = Value | -Value
- * Value            = Number | String | IdentifierAccess | (Expression)
+ * Value            = Number | String | IdentifierAccess | (Expression) | [Expressions]
  * IdentifierAccess = <Identifier><Access> | Identifier
- * Access           = None | .IdentifierAccess | [Expression]Access | (Parameters)Access
+ * Access           = None | .IdentifierAccess | [Expression]Access | [Slice]Access | (Parameters)Access
+ * Slice            = Expression:Expression, either side may be omitted
  */
 
 class Parser{
@@ -31,6 +32,8 @@ private:
     std::shared_ptr<ast::Expression> parse_value();
     std::shared_ptr<ast::Access> parse_identifier_access();
     std::shared_ptr<ast::Access> parse_access(std::shared_ptr<ast::Access> chain);
+    /* the index or slice after [, NULL if it is not closed */
+    std::shared_ptr<ast::Expression> parse_subscript();
     std::shared_ptr<ast::Identifier> parse_identifier();
 
     bool parse_char(char c);
@@ -40,6 +43,8 @@ private:
     void parse_char_or_panic(char c);
     Token &parse_token();
     Token &next();
+    /* no more tokens on this line */
+    bool at_line_end();
 
     bool parse_indentation();
     void increase_indentation();
@@ -0,0 +1,70 @@
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include "value.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* elements of the largest array a builtin creates, 2 GiB of numbers */
+#define MAX_ARRAY_LENGTH (1 << 28)
+
+namespace runtime {
+
+/*
+ * A typed array of unboxed numbers. All elements have the element type of
+ * the array and are stored contiguously, so the kernels below can run over
+ * them without looking at a single Value. Int64 arithmetic wraps around,
+ * loading an element that does not fit into 48 bits gives a double.
+ */
+class Array: public HeapObject {
+public:
+    enum ElementType {
+        Float64,
+        Int64,
+    };
+    ElementType type;
+    /* only the vector of the element type is used */
+    std::vector<double> doubles;
+    std::vector<int64_t> ints;
+
+    Array(ElementType type, size_t length) : HeapObject(HeapObject::Array), type(type), doubles(type == Float64 ? length : 0), ints(type == Int64 ? length : 0) {}
+
+    size_t length() const {
+        return type == Float64 ? doubles.size() : ints.size();
+    }
+    Value load(size_t index) const;
+    /* converts value to the element type, false if it is no fitting number */
+    bool store(size_t index, Value value);
+    std::string to_string() const;
+    size_t size() const override {
+        return sizeof(Array) + doubles.capacity() * sizeof(double) + ints.capacity() * sizeof(int64_t);
+    }
+};
+
+/*
+ * Element-wise and reducing loops over raw element storage. They use AVX2
+ * or SSE2 when the compiler targets it and plain loops otherwise.
+ */
+namespace kernels {
+
+void add(const double *a, const double *b, double *out, size_t n);
+void add(const int64_t *a, const int64_t *b, int64_t *out, size_t n);
+void mul(const double *a, const double *b, double *out, size_t n);
+void mul(const int64_t *a, const int64_t *b, int64_t *out, size_t n);
+double sum(const double *a, size_t n);
+int64_t sum(const int64_t *a, size_t n);
+double dot(const double *a, const double *b, size_t n);
+int64_t dot(const int64_t *a, const int64_t *b, size_t n);
+/* n must not be 0 */
+double min(const double *a, size_t n);
+int64_t min(const int64_t *a, size_t n);
+double max(const double *a, size_t n);
+int64_t max(const int64_t *a, size_t n);
+
+}
+
+}
+
+#endif
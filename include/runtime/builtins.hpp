@@ -0,0 +1,36 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "value.hpp"
+#include "lexer/symbol.hpp"
+
+#include <cstddef>
+#include <sys/types.h>
+
+namespace runtime {
+
+class Heap;
+
+/* reports its own errors and returns false on them */
+using BuiltinFunction = bool (*)(Heap &heap, Value *arguments, Value &result);
+
+class Builtin {
+public:
+    const char *name;
+    unsigned int num_parameters;
+    BuiltinFunction function;
+};
+
+/*
+ * Functions implemented by the runtime, called with CallBuiltin. A function
+ * defined in the script shadows the builtin of the same name.
+ */
+extern const Builtin builtins[];
+extern const size_t num_builtins;
+
+/* index into builtins, -1 if there is no builtin called name */
+ssize_t find_builtin(Symbol name);
+
+}
+
+#endif
@@ -1,137 +1,97 @@
 #ifndef BYTECODE_H
 #define BYTECODE_H
 
-#include "environment.hpp"
-#include "ast/ast.hpp"
-#include "value.hpp"
-
-#include <iostream>
+#include <cstdint>
+#include <cstring>
 
 namespace runtime {
 
-class Bytecode{
-public:
-    virtual void execute(Environment &env) = 0;
-    virtual void print() = 0;
-};
-
-class BinaryOp: public Bytecode{
-public:
-    void execute(Environment &env) override;
-private:
-    virtual Value perform_op(const Value &left, const Value &right) = 0;
-};
-
-class Add: public BinaryOp {
-public:
-    void print () {
-        std::cout << "Add" << std::endl;
-    }
-private:
-    Value perform_op(const Value &left, const Value &right) override {
-        return Value::add(left, right);
-    }
-};
-
-class Minus: public BinaryOp {
-public:
-    void print () {
-        std::cout << "Minus" << std::endl;
-    }
-private:
-    Value perform_op(const Value &left, const Value &right) override {
-        return Value::minus(left, right);
-    }
-};
-
-class Divide: public BinaryOp {
-public:
-    void print () {
-        std::cout << "Divide" << std::endl;
-    }
-private:
-    Value perform_op(const Value &left, const Value &right) override {
-        return Value::div(left, right);
-    }
-};
-
-class Multiply: public BinaryOp {
-public:
-    void print () {
-        std::cout << "Multiply" << std::endl;
-    }
-private:
-    Value perform_op(const Value &left, const Value &right) override {
-        return Value::mul(left, right);
-    }
+/*
+ * Instructions are stored in a flat byte stream: one opcode byte followed
+ * by the fixed number of 32 bit operands listed in opcode_info. Every code
+ * object ends in Return, ReturnVoid or a tail call. Jump targets are byte
+ * offsets into the stream.
+ */
+enum Opcode : uint8_t {
+    Add,
+    Minus,
+    Divide,
+    Multiply,
+    PushConstant,       // <constant>
+    PushVariable,       // <offset>
+    StoreVariable,      // <offset>
+    ObjectAccess,       // <attribute cache>
+    StoreAttribute,     // <attribute cache>
+    CallFunction,       // <function>
+    CallMethod,         // <method cache> <num_parameters>
+    CallConstructor,    // <class>
+    Negate,
+    Return,
+    ReturnVoid,
+    TailCallFunction,   // <function>
+    TailCallMethod,     // <method cache> <num_parameters>
+    Pop,
+    IndexLoad,
+    IndexStore,
+    CallBuiltin,        // <builtin> <num_parameters>
+    BuildList,          // <num_elements>
+    Slice,              // <bounds>  bit 0: start given, bit 1: stop given
+    GetIterator,
+    ForIter,            // <exit>  pushes the next element or leaves the loop
+    Jump,               // <target>
+    /*
+     * Quickened instructions. The interpreter rewrites a generic
+     * instruction into one of these after observing its operands and
+     * rewrites it back once the guard fails. They have the same operands
+     * as their generic form.
+     */
+    AddInt,
+    AddNumber,
+    AddString,
+    MinusInt,
+    MinusNumber,
+    DivideNumber,
+    MultiplyInt,
+    MultiplyNumber,
+    ObjectAccessMonomorphic,       // <attribute cache>
+    StoreAttributeMonomorphic,     // <attribute cache>
+    /*
+     * Superinstructions. The compiler fuses the most frequent sequences
+     * (see --profile-pairs) into one instruction, saving the dispatch and
+     * the stack traffic between them. StoreVariableKeep is only made by
+     * the peephole optimizer.
+     */
+    StoreVariableAttribute, // <offset> <attribute cache>  PushVariable, StoreAttribute
+    PushVariableAttribute,  // <offset> <attribute cache>  PushVariable, ObjectAccess
+    AddVariableNumber,      // <offset> <constant>         PushVariable, PushConstant, Add
+    MinusVariableNumber,    // <offset> <constant>         PushVariable, PushConstant, Minus
+    DivideVariableNumber,   // <offset> <constant>         PushVariable, PushConstant, Divide
+    MultiplyVariableNumber, // <offset> <constant>         PushVariable, PushConstant, Multiply
+    StoreVariableKeep,      // <offset>                    StoreVariable, PushVariable of the same offset
+    NumOpcodes
 };
 
-class PushValue: public Bytecode {
-public:
-    void execute(Environment &env) override;
-    PushValue(Value value) : value(value) {}
-    void print () {
-        std::cout << "PushValue " << value.to_string() << std::endl;
-    }
-private:
-    Value value;
-};
-
-class PushVariable: public Bytecode {
-public:
-    void execute(Environment &env) override;
-    PushVariable(ssize_t offset) : offset(offset) {}
-    void print () {
-        std::cout << "PushVariable %" << offset << std::endl;
-    }
-
-private:
-    size_t offset;
-};
+using Operand = uint32_t;
 
-class Set: public Bytecode {
-public:
-    void execute(Environment &env) override;
-    void print () {
-        std::cout << "Set" << std::endl;
-    }
+struct OpcodeInfo {
+    const char *name;
+    unsigned int num_operands;
+    /* values pushed minus values popped, calls depend on their callee, ForIter counts when it continues */
+    int stack_effect;
 };
 
-class PushLValue : public Bytecode {
-public:
-    void execute(Environment &env) override;
-    PushLValue(ssize_t offset) : offset(offset) {}
-    void print () {
-        std::cout << "PushLValue %" << offset <<  std::endl;
-    }
-
-private:
-    ssize_t offset;
+extern const OpcodeInfo opcode_info[NumOpcodes];
 
-};
-
-class ObjectAccessLValue: public Bytecode {
-public:
-    void execute(Environment &env) override;
-    ObjectAccessLValue(ast::Identifier identifier) : identifier(identifier.token.literal()) {}
-    void print () {
-        std::cout << "ObjectAccess LValue <" << identifier <<  ">\n";
-    }
-private:
-    std::string identifier;
-};
+inline Operand read_operand(const uint8_t *ip) {
+    Operand operand;
+    std::memcpy(&operand, ip, sizeof(Operand));
+    return operand;
+}
 
-class ObjectAccess : public Bytecode {
-public:
-    void execute(Environment &env) override;
-    ObjectAccess(ast::Identifier identifier) : identifier(identifier.token.literal()) {}
-    void print () {
-        std::cout << "ObjectAccess <" << identifier <<  ">\n";
-    }
-private:
-    std::string identifier;
-};
+inline size_t instruction_size(Opcode op) {
+    return 1 + opcode_info[op].num_operands * sizeof(Operand);
+}
 
 }
 
-#endif
\ No newline at end of file
+#endif
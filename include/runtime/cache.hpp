@@ -0,0 +1,109 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "value.hpp"
+#include "shape.hpp"
+
+#include <string>
+
+/* number of shapes an inline cache remembers before going megamorphic */
+#define POLYMORPHIC_CACHE_SIZE 4
+
+namespace runtime {
+
+class Method;
+class ClassStruct;
+
+/*
+ * Inline cache of one ObjectAccess or StoreAttribute instruction.
+ * It remembers the slot of its attribute for up to POLYMORPHIC_CACHE_SIZE
+ * receiver shapes. Stores that add the attribute also remember the shape
+ * the object transitions to. Once more shapes show up, the cache turns
+ * megamorphic and every execution does the full shape lookup.
+ */
+class AttributeCache {
+public:
+    class Entry {
+    public:
+        Shape *shape;
+        size_t slot;
+        Shape *transition; /* shape after adding the attribute, NULL if it already exists */
+    };
+
+    Symbol name;
+    Entry entries[POLYMORPHIC_CACHE_SIZE];
+    unsigned int size;
+    bool megamorphic;
+    size_t hits, misses;
+
+    AttributeCache(Symbol name) : name(name), size(0), megamorphic(false), hits(0), misses(0) {}
+
+    Value load(Object *obj) {
+        for (unsigned int i = 0; i < size; i++) {
+            if (entries[i].shape == obj->shape) {
+                hits++;
+                return obj->slots[entries[i].slot];
+            }
+        }
+        return load_miss(obj);
+    }
+
+    /* returns the bytes the slots of obj grew by, for the heap's accounting */
+    size_t store(Object *obj, Value value) {
+        for (unsigned int i = 0; i < size; i++) {
+            if (entries[i].shape == obj->shape) {
+                hits++;
+                return store_entry(entries[i], obj, value);
+            }
+        }
+        return store_miss(obj, value);
+    }
+    static size_t store_entry(const Entry &entry, Object *obj, Value value) {
+        if (entry.transition) {
+            obj->shape = entry.transition;
+            return obj->add_slot(value);
+        }
+        obj->slots[entry.slot] = value;
+        return 0;
+    }
+
+    bool is_monomorphic() const {
+        return size == 1;
+    }
+    const char *state() const;
+    void print_stats() const;
+private:
+    Value load_miss(Object *obj);
+    size_t store_miss(Object *obj, Value value);
+    void remember(Shape *shape, size_t slot, Shape *transition);
+};
+
+/*
+ * Call site cache of one CallMethod instruction, keyed on the receiver's
+ * class. A miss resolves the method through the class' method table.
+ */
+class MethodCache {
+public:
+    Symbol name;
+    ClassStruct *class_struct;
+    Method *method;
+    size_t hits, misses;
+
+    MethodCache(Symbol name) : name(name), class_struct(NULL), method(NULL), hits(0), misses(0) {}
+
+    Method *lookup(ClassStruct *receiver_class) {
+        if (receiver_class == class_struct) {
+            hits++;
+            return method;
+        }
+        return lookup_miss(receiver_class);
+    }
+
+    void print_stats() const;
+private:
+    Method *lookup_miss(ClassStruct *receiver_class);
+};
+
+}
+
+#endif
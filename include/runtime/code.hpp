@@ -1,9 +1,14 @@
 #ifndef CODE_H
 #define CODE_H
 
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "bytecode.hpp"
+#include "cache.hpp"
+#include "environment.hpp"
 #include "value.hpp"
 #include "ast/ast.hpp"
 
@@ -14,15 +19,76 @@ class ClassStruct;
 
 class Code {
 private:
+    void print_instruction(const uint8_t *ip);
+    /* indices of pooled constants, numbers are keyed by their boxed word */
+    std::unordered_map<uint64_t, Operand> number_constants;
+    std::unordered_map<std::string, Operand> string_constants;
+    /* constant strings are owned by the code and never collected */
+    std::vector<std::unique_ptr<String>> strings;
+    /* instructions before the last label, they are never looked at by opcode_back */
+    size_t label_instruction;
 public:
-    std::vector<std::unique_ptr<Bytecode>> bytecodes;
-    std::vector<std::string> variables;
+    std::vector<uint8_t> bytecodes;
+    /* start of every instruction in bytecodes, so the compiler can rewrite the tail */
+    std::vector<size_t> instructions;
+    std::vector<Symbol> variables;
+    /* tables referenced by instruction operands */
+    std::vector<Symbol> names;
+    std::vector<std::shared_ptr<Function>> functions;
+    std::vector<std::shared_ptr<ClassStruct>> classes;
+    /* constant pool, equal numbers and strings share one entry */
+    std::vector<Value> constants;
+    /* one inline cache per attribute access instruction */
+    std::vector<AttributeCache> attribute_caches;
+    /* one call site cache per method call instruction */
+    std::vector<MethodCache> method_caches;
+    /* slots for arguments and variables, set by finish() */
+    size_t frame_size;
+    /* deepest the operand stack above the frame gets, set by finish() */
+    size_t max_stack;
+    /* slots after the variables for values the optimizer keeps in the frame */
+    size_t temporaries;
+
+    Code() : label_instruction(0), frame_size(0), max_stack(0), temporaries(0) {}
 
-    Code(std::vector<std::unique_ptr<Bytecode>> && bytecodes) : bytecodes(std::move(bytecodes)) {}
-    Code() = default;
-
-    Value run();
     virtual void print();
+    virtual void print_stats();
+    /* names the code in dumps, like "Function f" */
+    virtual std::string describe() {
+        return "Code";
+    }
+    std::string constant_to_string(Operand index);
+    /* values the instruction at ip pushes minus those it pops */
+    int stack_effect(const uint8_t *ip);
+    /* values the caller passes in the first slots of the frame */
+    virtual int num_arguments() {
+        return 0;
+    }
+    /* terminates the code and computes its frame layout, once everything is compiled */
+    void finish();
+
+    void emit(Opcode op);
+    void emit(Opcode op, Operand operand);
+    void emit(Opcode op, Operand first, Operand second);
+    /* the instruction distance places before the last one, NumOpcodes if there is none */
+    Opcode opcode_back(size_t distance);
+    Operand operand_back(size_t distance, size_t index);
+    /* patches an operand of the instruction starting at position, used for forward jumps */
+    void set_operand(size_t position, size_t index, Operand operand);
+    void drop_back(size_t count);
+    /* marks the end of bytecodes as a jump target and returns its offset */
+    size_t label();
+    /* replaces the tail with a superinstruction if it ends in a fused sequence */
+    void fuse_superinstruction();
+    Operand number_constant(Value number);
+    /* the value of variables before their first store */
+    Operand void_constant();
+    Operand string_constant(const std::string &str);
+    Operand name_index(Symbol name);
+    Operand function_index(std::shared_ptr<Function> function);
+    Operand class_index(std::shared_ptr<ClassStruct> class_struct);
+    Operand attribute_cache(Symbol name);
+    Operand method_cache(Symbol name);
 
     ssize_t variable_offset_or_create(std::shared_ptr<ast::Identifier> );
     virtual ssize_t variable_offset_or_create(const ast::Identifier &);
@@ -30,15 +96,21 @@ public:
 
 class Function: public Code {
 public:
-    std::vector<std::string> parameters;
-    std::string name;
+    std::vector<Symbol> parameters;
+    Symbol name;
 
     void print() override;
-    bool has_return_value(const std::unique_ptr<Environment> &);
+    void print_stats() override;
+    std::string describe() override {
+        return "Function " + symbol_name(name);
+    }
+    int num_arguments() override {
+        return parameters.size();
+    }
 
-    Function(const ast::FunctionDefinition &ast) : Code(), name(ast.name->token.literal()) {
+    Function(const ast::FunctionDefinition &ast) : Code(), name(ast.name->token.symbol) {
         for (auto ast_param = ast.parameters.begin(); ast_param != ast.parameters.end(); ast_param++) {
-            parameters.push_back(ast_param->get()->token.literal());
+            parameters.push_back(ast_param->get()->token.symbol);
         }
     }
 
@@ -47,19 +119,24 @@ public:
 
 class Method: public Code {
 public:
-    std::vector<std::string> parameters;
-    std::string name;
+    std::vector<Symbol> parameters;
+    Symbol name;
     std::shared_ptr<ClassStruct> class_struct;
 
     void print() override;
-    bool has_return_value(const std::unique_ptr<Environment> &);
+    void print_stats() override;
+    std::string describe() override;
+    /* self and the parameters */
+    int num_arguments() override {
+        return parameters.size() + 1;
+    }
 
-    Method(const ast::MethodDefinition &ast, std::shared_ptr<ClassStruct> class_) : Code(), name(ast.name->token.literal()), class_struct(class_) {
-        if (ast.parameters.front()->token.literal() != std::string("self")) {
-            std::cout << "Error: Method " << name << " must start with self parameter\n";
+    Method(const ast::MethodDefinition &ast, std::shared_ptr<ClassStruct> class_) : Code(), name(ast.name->token.symbol), class_struct(class_) {
+        if (symbol_name(ast.parameters.front()->token.symbol) != "self") {
+            std::cout << "Error: Method " << symbol_name(name) << " must start with self parameter\n";
         }
         for (auto ast_param = std::next(ast.parameters.begin()); ast_param != ast.parameters.end(); ast_param++) {
-            parameters.push_back(ast_param->get()->token.literal());
+            parameters.push_back(ast_param->get()->token.symbol);
         }
     }
     ssize_t variable_offset_or_create(const ast::Identifier &) override;
@@ -68,48 +145,28 @@ public:
 class ClassStruct: public Code {
 public:
     std::vector<std::shared_ptr<Method>> methods;
-    std::string name;
+    Symbol name;
+    /* shape of freshly constructed objects, root of the class' shape tree */
+    Shape root_shape;
 
     void print() override;
+    void print_stats() override;
 
-    ClassStruct(const ast::ClassDefinition &ast) : Code(), name(ast.name) {}
-    std::shared_ptr<Method> constructor();
-    std::shared_ptr<Method> find_method(std::string method_name);
-};
-
-class CallFunction: public Bytecode {
-public:
-    void execute(Environment &env) override;
-    CallFunction(std::shared_ptr<Function> function): function(function) {}
-    void print () {
-        std::cout << "CallFunction " << function->name << std::endl;
-    }
-private:
-    std::shared_ptr<Function> function;
-};
-
-class CallMethod: public Bytecode {
-public:
-    void execute(Environment &env) override;
-    CallMethod(std::string name, ssize_t num_parameters): num_parameters(num_parameters), name(name) {}
-    void print () {
-        std::cout << "CallMethod " << name << std::endl;
+    ClassStruct(const ast::ClassDefinition &ast) : Code(), name(SymbolTable::global().intern(ast.name)), init(NULL) {}
+    void add_method(std::shared_ptr<Method> method);
+    Method *constructor() {
+        return init;
     }
+    /* reports a missing method, for calls at run time */
+    Method *find_method(Symbol method_name);
+    /* NULL if the class has no such method */
+    Method *lookup_method(Symbol method_name);
 private:
-    ssize_t num_parameters;
-    std::string name;
+    /* built while compiling, so lookups never scan methods */
+    std::unordered_map<Symbol, Method *> method_table;
+    Method *init;
 };
 
-class CallConstructor : public Bytecode {
-public:
-    void execute(Environment &env) override;
-    CallConstructor(std::shared_ptr<runtime::ClassStruct> class_struct) : class_struct(class_struct) {}
-    void print() {
-        std::cout << "CallConstructor " << class_struct->name << std::endl;
-    }
-private:
-    std::shared_ptr<runtime::ClassStruct> class_struct;
-};
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -2,13 +2,16 @@
 #define COMPILE_RUNTIME_H
 
 #include "ast/ast.hpp"
+#include "ir/passes.hpp"
 #include "runtime/code.hpp"
 
 class BytecodeCompiler: public ast::Visitor {
     std::shared_ptr<runtime::Code> current;
 
     void visit_binary_op(ast::BinaryOp &) override;
+    void visit_unary_op(ast::UnaryOp &) override;
     void visit_number(ast::Number &) override;
+    void visit_string(ast::String &) override;
     void visit_assign_stmt(ast::Assign &) override;
     void visit_return_stmt(ast::Return &) override;
     void visit_identifier(ast::Identifier &) override;
@@ -19,11 +22,17 @@ class BytecodeCompiler: public ast::Visitor {
     void visit_class_definition(ast::ClassDefinition &) override;
     void visit_method_definition(ast::MethodDefinition &) override;
     void visit_class_access(ast::ClassAccess &) override;
+    void visit_index_access(ast::IndexAccess &) override;
+    void visit_list(ast::List &) override;
+    void visit_for_stmt(ast::For &) override;
 
-    void visit_constructor(ast::FunctionCall &, std::string);
+    void visit_constructor(ast::FunctionCall &, Symbol);
+    void visit_builtin(ast::FunctionCall &, size_t);
+    void visit_parameters(ast::FunctionCall &);
+    void fuse_superinstruction();
 
     std::shared_ptr<runtime::Function> find_function(ast::FunctionCall &);
-    std::shared_ptr<runtime::ClassStruct> find_class(const std::string &);
+    std::shared_ptr<runtime::ClassStruct> find_class(Symbol);
     void activate_lvalue();
     void deactivate_lvalue();
     bool lvalue;
@@ -37,8 +46,14 @@ class BytecodeCompiler: public ast::Visitor {
 public:
     std::vector<std::shared_ptr<runtime::Function>> functions;
     std::vector<std::shared_ptr<runtime::ClassStruct>> classes;
+    /* fuse frequent instruction sequences while emitting */
+    bool superinstructions;
+    /* rewrites every code object once compiled, NULL at -O0 */
+    ir::PassManager *optimizer;
+    /* rewrites redundant instruction sequences last */
+    bool peephole;
     std::shared_ptr<runtime::Code> code();
-    BytecodeCompiler() : current(std::shared_ptr<runtime::Code>(new runtime::Code())), lvalue(false), class_access(0) {}
+    BytecodeCompiler() : current(std::shared_ptr<runtime::Code>(new runtime::Code())), lvalue(false), class_access(0), superinstructions(true), optimizer(NULL), peephole(true) {}
 };
 
 #endif
\ No newline at end of file
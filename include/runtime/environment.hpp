@@ -2,22 +2,74 @@
 #define ENVIRONMENT_H
 
 #include <vector>
+#include <cstdint>
 
 #include "value.hpp"
 
+/* number of value slots preallocated for one execution */
+#define DEFAULT_STACK_SIZE (1 << 16)
+/* number of nested calls allowed before execution is aborted */
+#define DEFAULT_MAX_DEPTH 10000
+
 namespace runtime {
 
+class Code;
+class Method;
+class Heap;
+
+class Frame {
+public:
+    Code *code;
+    uint8_t *ip; /* where to continue once the callee returned */
+    Value *base;
+};
+
+/*
+ * One contiguous value stack per execution. A call does not copy its
+ * arguments anywhere: the callee's frame starts at the first argument the
+ * caller pushed, and its return value is written back into that slot.
+ * The compiler sizes every frame, so a call reserves its slots at once.
+ *
+ * Calls never recurse on the C++ stack. They push a Frame and the single
+ * run loop in execute() continues in the callee.
+ */
 class Environment {
 public:
     std::vector<Value> stack;
-    std::unique_ptr<Environment> child;
-    Environment *parent;
-    Value pop();
-    void push(Value v);
+    std::vector<Frame> frames;
+    Value *sp;   /* first free slot */
+    Value *base; /* first slot of the running frame */
+    Heap *heap;
+    size_t max_depth;
+    /* counts of executed opcode pairs, indexed by previous * NumOpcodes + next */
+    std::vector<size_t> pair_counts;
+    bool profile_pairs;
+
+    Environment(Heap &heap, size_t stack_size = DEFAULT_STACK_SIZE, size_t max_depth = DEFAULT_MAX_DEPTH) : stack(stack_size, Value::create_void()), sp(stack.data()), base(stack.data()), heap(&heap), max_depth(max_depth), profile_pairs(false) {}
+    Environment(const Environment &) = delete;
+    Environment &operator=(const Environment &) = delete;
+
+    Value pop() {
+        return *--sp;
+    }
+    void push(Value v) {
+        *sp++ = v;
+    }
     bool is_empty();
+    /* collects garbage if due, every live value has to be on the stack */
+    void safepoint();
     void print_stack();
+    void print_pair_profile(size_t max_pairs);
+    Value run(Code &code);
+private:
+    bool check_frame(Value *frame);
+    bool push_frame(Code &code, Value *frame, uint8_t *return_ip);
+    bool replace_frame(Code &code, Value *arguments);
+    bool check_arguments(Method &method, size_t num_parameters);
+    bool execute(size_t entry_depth);
+    void unwind(size_t entry_depth);
 };
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,87 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "value.hpp"
+
+#include <utility>
+#include <vector>
+
+/* bytes allocated before the first collection */
+#define DEFAULT_GC_THRESHOLD (1 << 20)
+/* after a collection the next one is due at live bytes * growth factor */
+#define DEFAULT_GC_GROWTH_FACTOR 2.0
+
+namespace runtime {
+
+class Environment;
+
+class HeapStats {
+public:
+    size_t collections = 0;
+    size_t freed_objects = 0;
+    size_t live_objects = 0;
+    size_t live_bytes = 0;
+    double total_pause_ms = 0;
+    double max_pause_ms = 0;
+    void print() const;
+};
+
+/*
+ * Owns every string and object created while running code. Values only
+ * carry raw pointers into the heap, so copying them never touches a
+ * reference count. Unreachable objects are reclaimed by a precise
+ * mark-sweep collection whose roots are the values on the stack.
+ *
+ * collect() must only be called at safepoints, where every live value is
+ * stored on the stack of the environment.
+ */
+class Heap {
+private:
+    HeapObject *objects;
+    size_t bytes_allocated;
+    size_t next_collection;
+    std::vector<HeapObject *> gray;
+    void sweep();
+public:
+    size_t threshold;
+    double growth_factor;
+    HeapStats stats;
+
+    Heap(size_t threshold = DEFAULT_GC_THRESHOLD, double growth_factor = DEFAULT_GC_GROWTH_FACTOR) : objects(NULL), bytes_allocated(0), next_collection(threshold), threshold(threshold), growth_factor(growth_factor) {}
+    Heap(const Heap &) = delete;
+    Heap &operator=(const Heap &) = delete;
+    ~Heap();
+
+    template<typename T, typename... Args>
+    T *allocate(Args &&... args) {
+        T *obj = new T(std::forward<Args>(args)...);
+        bytes_allocated += obj->size();
+        obj->next = objects;
+        objects = obj;
+        return obj;
+    }
+
+    /* counts memory an object allocated after it was created */
+    void grew(size_t bytes) {
+        bytes_allocated += bytes;
+    }
+    bool should_collect() const {
+        return bytes_allocated >= next_collection;
+    }
+    void collect(Environment &env);
+
+    void mark(Value value) {
+        if (value.is_heap_object())
+            mark(value.heap_object());
+    }
+    void mark(HeapObject *obj) {
+        if (obj->marked)
+            return;
+        obj->marked = true;
+        gray.push_back(obj);
+    }
+};
+
+}
+
+#endif
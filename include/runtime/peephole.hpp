@@ -0,0 +1,56 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "code.hpp"
+
+#include <vector>
+
+namespace runtime {
+
+/* an instruction of the bytecode being rewritten */
+class PeepholeInstruction {
+public:
+    /* offset in the bytecode before rewriting, jumps refer to it */
+    size_t position;
+    Opcode op;
+    Operand operands[2];
+};
+
+/* whether the operands of the matched instructions allow a rewrite */
+using PeepholeCondition = bool (*)(Code &code, const PeepholeInstruction *matched);
+
+/* the replacement takes no operands from the matched instructions */
+#define NO_OPERANDS -1
+
+/* an instruction of a replacement, with the operands of the matched instruction at index operands */
+class PeepholeEmit {
+public:
+    Opcode op;
+    int operands;
+};
+
+class PeepholeRule {
+public:
+    const char *name;
+    std::vector<Opcode> pattern;
+    /* NULL if the opcodes are enough */
+    PeepholeCondition condition;
+    std::vector<PeepholeEmit> replacement;
+};
+
+/* tried in order at every instruction, the first one matching is applied */
+extern const PeepholeRule peephole_rules[];
+extern const size_t num_peephole_rules;
+
+/*
+ * Rewrites the bytecode of finished code with peephole_rules until none
+ * applies, fusing superinstructions again if asked to. A pattern never
+ * spans a jump target. A replacement must have the stack effect of the
+ * instructions it replaces, a rule breaking that is reported and not
+ * applied. Returns the number of rewrites.
+ */
+size_t optimize_peephole(Code &code, bool superinstructions);
+
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "lexer/symbol.hpp"
+
+namespace runtime {
+
+/*
+ * A Shape describes the attribute layout shared by all objects that got
+ * the same attributes assigned in the same order. Adding an attribute moves
+ * an object along a transition to a child shape, so objects only have to
+ * store a dense vector of slots.
+ */
+class Shape {
+public:
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+    Shape *parent;
+    /* attribute names in slot order */
+    std::vector<Symbol> names;
+
+    Shape() : parent(NULL) {}
+    Shape(const Shape &) = delete;
+    Shape &operator=(const Shape &) = delete;
+
+    size_t lookup(Symbol name) const {
+        auto entry = slots.find(name);
+        if (entry != slots.end())
+            return entry->second;
+        return NOT_FOUND;
+    }
+    Shape *transition(Symbol name);
+    size_t size() const {
+        return names.size();
+    }
+private:
+    std::unordered_map<Symbol, size_t> slots;
+    std::unordered_map<Symbol, std::unique_ptr<Shape>> transitions;
+};
+
+}
+
+#endif
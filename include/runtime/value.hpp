@@ -3,56 +3,248 @@
 
 #include <string>
 #include <memory>
-#include <variant>
-#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "shape.hpp"
+
+/* concatenations shorter than this are copied right away instead of becoming ropes */
+#define ROPE_MIN_LENGTH 64
 
 namespace runtime {
 
 class Object;
+class String;
+class Array;
+class List;
+class HeapObject;
+class Heap;
 class Environment;
 class ClassStruct;
 
+/*
+ * A Value is a NaN-boxed 64 bit word. Doubles are stored as they are,
+ * everything else lives inside the negative quiet NaN space:
+ *
+ *   1111 1111 1111 1ttt pppp ... pppp
+ *
+ * where t is a 3 bit tag and p a 48 bit payload (a pointer for heap values,
+ * a two's complement integer for ints). NaNs produced by arithmetic are
+ * canonicalized to a positive quiet NaN so they never collide with a boxed
+ * value.
+ *
+ * Integers are exact as long as they fit into 48 bits. Arithmetic on ints
+ * is done in int64 and results that do not fit are promoted to doubles.
+ */
 class Value {
 private:
-    enum Type {
-        String,
-        Number,
-        Object,
-        StackLValue,
-        HeapLValue,
-        Void 
+    enum Tag : uint64_t {
+        VoidTag = 1,
+        HeapTag = 2,
+        IntTag = 3,
     };
-    using ValueType = std::variant<std::string, float, std::shared_ptr<runtime::Object>, Value *, ssize_t>;
-    ValueType value;
-    Value(ValueType value, Type type) : value(value), type(type) {}
+    static constexpr uint64_t BOX_MASK = 0xFFF8000000000000;
+    static constexpr uint64_t TAG_SHIFT = 48;
+    static constexpr uint64_t TAG_MASK = 0x0007000000000000;
+    static constexpr uint64_t PAYLOAD_MASK = 0x0000FFFFFFFFFFFF;
+    static constexpr uint64_t CANONICAL_NAN = 0x7FF8000000000000;
+    static constexpr int64_t INT_MAX_VALUE = (static_cast<int64_t>(1) << 47) - 1;
+    static constexpr int64_t INT_MIN_VALUE = -(static_cast<int64_t>(1) << 47);
+
+    uint64_t bits;
+
+    Value(Tag tag, uint64_t payload) : bits(BOX_MASK | (static_cast<uint64_t>(tag) << TAG_SHIFT) | (payload & PAYLOAD_MASK)) {}
+    bool has_tag(Tag tag) const {
+        return (bits & (BOX_MASK | TAG_MASK)) == (BOX_MASK | (static_cast<uint64_t>(tag) << TAG_SHIFT));
+    }
+    uint64_t payload() const {
+        return bits & PAYLOAD_MASK;
+    }
 public:
-    Type type;
-    Value(float f) : value(f), type(Number) {}
-    Value(std::string s) : value(s), type(String) {}
-    Value(std::shared_ptr<runtime::Object> obj) : value(obj), type(Object) {}
-
-    Value *location(Environment &env);
-    std::shared_ptr<runtime::Object> object(Environment &env);
-    std::string to_string() const; // include Lvalues and Objects here
-    static Value add(const Value &a, const Value &b);
+    Value(double d);
+    Value(HeapObject *obj) : Value(HeapTag, reinterpret_cast<uint64_t>(obj)) {}
+
+    bool is_double() const {
+        return (bits & BOX_MASK) != BOX_MASK;
+    }
+    bool is_int() const {
+        return has_tag(IntTag);
+    }
+    /* ints and doubles */
+    bool is_number() const {
+        return is_double() or is_int();
+    }
+    int64_t int_value() const {
+        return static_cast<int64_t>(bits << 16) >> 16;
+    }
+    bool is_void() const {
+        return has_tag(VoidTag);
+    }
+    bool is_heap_object() const {
+        return has_tag(HeapTag);
+    }
+    HeapObject *heap_object() const {
+        return reinterpret_cast<HeapObject *>(payload());
+    }
+    bool is_string() const;
+    bool is_object() const;
+    bool is_array() const;
+    bool is_list() const;
+    /* value of an int or double as a double */
+    double number() const;
+    String *string() const;
+    List *list() const;
+    /* the boxed word itself, equal for identical constants */
+    uint64_t raw() const {
+        return bits;
+    }
+
+    runtime::Object *object();
+    /* the array, NULL and an error for anything else */
+    runtime::Array *array();
+    std::string to_string() const;
+    static Value add(Heap &heap, const Value &a, const Value &b);
     static Value minus(const Value &a, const Value &b);
     static Value div(const Value &a, const Value &b);
     static Value mul(const Value &a, const Value &b);
+    static Value negate(const Value &a);
+    /* a copy of sequence[start:stop], start and stop are void when omitted */
+    static Value slice(Heap &heap, const Value &sequence, const Value &start, const Value &stop);
     static Value create_void();
-    static Value create_stack_lvalue(ssize_t offset);
-    static Value create_heap_lvalue(Value *);
+    /* boxes i as int, or as double if it needs more than 48 bits */
+    static Value create_int(int64_t i) {
+        if (i < INT_MIN_VALUE or i > INT_MAX_VALUE)
+            return Value(static_cast<double>(i));
+        return Value(IntTag, static_cast<uint64_t>(i));
+    }
+};
+
+static_assert(sizeof(Value) == 8, "Value must fit into a single machine word");
+static_assert(std::is_trivially_copyable_v<Value>, "Value must be trivially copyable");
+
+class HeapObject {
+public:
+    enum Kind {
+        String,
+        Object,
+        Array,
+        List,
+    };
+    Kind kind;
+    bool marked;
+    HeapObject *next;
+    HeapObject(Kind kind) : kind(kind), marked(false), next(NULL) {}
+    virtual ~HeapObject() = default;
+    /* bytes owned by this object, used for the collector's accounting */
+    virtual size_t size() const = 0;
+    /* marks every heap object referenced by this one */
+    virtual void trace(Heap &) {}
+};
+
+/*
+ * A long concatenation produces a rope: a String that only references its
+ * two halves. The characters are copied once, when flat() is first asked
+ * for them, so building a string piece by piece stays linear.
+ */
+class String: public HeapObject {
+public:
+    /* number of characters, also known for ropes */
+    size_t length;
+
+    String(std::string value) : HeapObject(HeapObject::String), length(value.size()), left(NULL), right(NULL), value(std::move(value)) {}
+    String(String *left, String *right) : HeapObject(HeapObject::String), length(left->length + right->length), left(left), right(right) {}
+
+    static String *concat(Heap &heap, String *left, String *right);
+    bool is_rope() const {
+        return left != NULL;
+    }
+    /* the characters, turns a rope into a flat string counted by heap */
+    const std::string &flat(Heap &heap);
+    /* a copy of the characters that leaves a rope as it is */
+    std::string characters() const;
+    size_t size() const override {
+        return sizeof(String) + value.capacity();
+    }
+    void trace(Heap &heap) override;
+private:
+    String *left, *right;
+    std::string value;
 };
 
-class Object {
+class Object: public HeapObject {
 public:
-    std::shared_ptr<runtime::ClassStruct> class_struct;
-    std::unordered_map<std::string, Value> attributes;
-    Value find_attribute(std::string name);
-    Value *find_attribute_lvalue(std::string name);
+    ClassStruct *class_struct;
+    Shape *shape;
+    /* attribute values, indexed by the slots of shape */
+    std::vector<Value> slots;
+    Value find_attribute(Symbol name);
+    /* stores value, adding the attribute if needed, and returns the bytes slots grew by */
+    size_t set_attribute(Symbol name, Value value);
+    /* appends the slot of a new attribute and returns the bytes slots grew by */
+    size_t add_slot(Value value);
     std::string to_string() const;
-    Object(std::shared_ptr<runtime::ClassStruct> class_) : class_struct(class_) {}
+    Object(ClassStruct *class_);
+    size_t size() const override {
+        return sizeof(Object) + slots.capacity() * sizeof(Value);
+    }
+    void trace(Heap &heap) override;
 };
 
+/* a sequence of values in one contiguous buffer, growing geometrically */
+class List: public HeapObject {
+public:
+    std::vector<Value> elements;
+
+    List(std::vector<Value> elements) : HeapObject(HeapObject::List), elements(std::move(elements)) {}
+    /* appends value in amortized constant time and returns the bytes the buffer grew by */
+    size_t append(Value value);
+    std::string to_string() const;
+    size_t size() const override {
+        return sizeof(List) + elements.capacity() * sizeof(Value);
+    }
+    void trace(Heap &heap) override;
+};
+
+inline bool Value::is_string() const {
+    return has_tag(HeapTag) and heap_object()->kind == HeapObject::String;
+}
+
+inline bool Value::is_object() const {
+    return has_tag(HeapTag) and heap_object()->kind == HeapObject::Object;
+}
+
+inline bool Value::is_array() const {
+    return has_tag(HeapTag) and heap_object()->kind == HeapObject::Array;
+}
+
+inline bool Value::is_list() const {
+    return has_tag(HeapTag) and heap_object()->kind == HeapObject::List;
+}
+
+inline double Value::number() const {
+    if (is_int())
+        return static_cast<double>(int_value());
+    double d;
+    std::memcpy(&d, &bits, sizeof(double));
+    return d;
+}
+
+inline Value::Value(double d) {
+    std::memcpy(&bits, &d, sizeof(double));
+    if (d != d)
+        bits = CANONICAL_NAN;
+}
+
+inline String *Value::string() const {
+    return static_cast<runtime::String *>(heap_object());
+}
+
+inline List *Value::list() const {
+    return static_cast<runtime::List *>(heap_object());
+}
+
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,286 @@
+#include "runtime/array.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace runtime;
+
+/* elements printed before the rest is abbreviated */
+#define ARRAY_PRINT_LIMIT 16
+
+Value Array::load(size_t index) const {
+    if (type == Float64)
+        return Value(doubles[index]);
+    return Value::create_int(ints[index]);
+}
+
+bool Array::store(size_t index, Value value) {
+    if (type == Float64 and value.is_number()) {
+        doubles[index] = value.number();
+        return true;
+    }
+    if (type == Int64 and value.is_int()) {
+        ints[index] = value.int_value();
+        return true;
+    }
+    std::cout << "Error: cannot store " << value.to_string() << " in an " << (type == Float64 ? "float64" : "int64") << " array\n";
+    return false;
+}
+
+std::string Array::to_string() const {
+    std::string str = type == Float64 ? "Float64Array[" : "Int64Array[";
+    for (size_t index = 0; index < length() and index < ARRAY_PRINT_LIMIT; index++) {
+        if (index)
+            str += ", ";
+        str += type == Float64 ? std::to_string(doubles[index]) : std::to_string(ints[index]);
+    }
+    if (length() > ARRAY_PRINT_LIMIT)
+        str += ", ... (" + std::to_string(length()) + " elements)";
+    str += "]";
+    return str;
+}
+
+/* int64 elements wrap around on overflow instead of being undefined */
+static inline int64_t wrapping_add(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+}
+
+static inline int64_t wrapping_mul(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+}
+
+#if defined(__AVX2__)
+static inline double horizontal_sum(__m256d v) {
+    __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+static inline int64_t horizontal_sum(__m256i v) {
+    alignas(32) int64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), v);
+    return wrapping_add(wrapping_add(lanes[0], lanes[1]), wrapping_add(lanes[2], lanes[3]));
+}
+#elif defined(__SSE2__)
+static inline double horizontal_sum(__m128d v) {
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+static inline int64_t horizontal_sum(__m128i v) {
+    alignas(16) int64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), v);
+    return wrapping_add(lanes[0], lanes[1]);
+}
+#endif
+
+void kernels::add(const double *a, const double *b, double *out, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+#elif defined(__SSE2__)
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+#endif
+    for (; i < n; i++)
+        out[i] = a[i] + b[i];
+}
+
+void kernels::add(const int64_t *a, const int64_t *b, int64_t *out, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= n; i += 4) {
+        __m256i sum = _mm256_add_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), sum);
+    }
+#elif defined(__SSE2__)
+    for (; i + 2 <= n; i += 2) {
+        __m128i sum = _mm_add_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), sum);
+    }
+#endif
+    for (; i < n; i++)
+        out[i] = wrapping_add(a[i], b[i]);
+}
+
+void kernels::mul(const double *a, const double *b, double *out, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+#elif defined(__SSE2__)
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+#endif
+    for (; i < n; i++)
+        out[i] = a[i] * b[i];
+}
+
+/* neither AVX2 nor SSE2 multiply 64 bit lanes, the compiler may still unroll this */
+void kernels::mul(const int64_t *a, const int64_t *b, int64_t *out, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        out[i] = wrapping_mul(a[i], b[i]);
+}
+
+double kernels::sum(const double *a, size_t n) {
+    size_t i = 0;
+    double result = 0;
+#if defined(__AVX2__)
+    __m256d partial = _mm256_setzero_pd();
+    for (; i + 4 <= n; i += 4)
+        partial = _mm256_add_pd(partial, _mm256_loadu_pd(a + i));
+    result = horizontal_sum(partial);
+#elif defined(__SSE2__)
+    __m128d partial = _mm_setzero_pd();
+    for (; i + 2 <= n; i += 2)
+        partial = _mm_add_pd(partial, _mm_loadu_pd(a + i));
+    result = horizontal_sum(partial);
+#endif
+    for (; i < n; i++)
+        result += a[i];
+    return result;
+}
+
+int64_t kernels::sum(const int64_t *a, size_t n) {
+    size_t i = 0;
+    int64_t result = 0;
+#if defined(__AVX2__)
+    __m256i partial = _mm256_setzero_si256();
+    for (; i + 4 <= n; i += 4)
+        partial = _mm256_add_epi64(partial, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)));
+    result = horizontal_sum(partial);
+#elif defined(__SSE2__)
+    __m128i partial = _mm_setzero_si128();
+    for (; i + 2 <= n; i += 2)
+        partial = _mm_add_epi64(partial, _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+    result = horizontal_sum(partial);
+#endif
+    for (; i < n; i++)
+        result = wrapping_add(result, a[i]);
+    return result;
+}
+
+double kernels::dot(const double *a, const double *b, size_t n) {
+    size_t i = 0;
+    double result = 0;
+#if defined(__AVX2__)
+    __m256d partial = _mm256_setzero_pd();
+    for (; i + 4 <= n; i += 4)
+        partial = _mm256_add_pd(partial, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    result = horizontal_sum(partial);
+#elif defined(__SSE2__)
+    __m128d partial = _mm_setzero_pd();
+    for (; i + 2 <= n; i += 2)
+        partial = _mm_add_pd(partial, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    result = horizontal_sum(partial);
+#endif
+    for (; i < n; i++)
+        result += a[i] * b[i];
+    return result;
+}
+
+int64_t kernels::dot(const int64_t *a, const int64_t *b, size_t n) {
+    int64_t result = 0;
+    for (size_t i = 0; i < n; i++)
+        result = wrapping_add(result, wrapping_mul(a[i], b[i]));
+    return result;
+}
+
+double kernels::min(const double *a, size_t n) {
+    size_t i = 1;
+    double result = a[0];
+#if defined(__AVX2__)
+    if (n >= 4) {
+        __m256d partial = _mm256_loadu_pd(a);
+        for (i = 4; i + 4 <= n; i += 4)
+            partial = _mm256_min_pd(partial, _mm256_loadu_pd(a + i));
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, partial);
+        result = *std::min_element(lanes, lanes + 4);
+    }
+#elif defined(__SSE2__)
+    if (n >= 2) {
+        __m128d partial = _mm_loadu_pd(a);
+        for (i = 2; i + 2 <= n; i += 2)
+            partial = _mm_min_pd(partial, _mm_loadu_pd(a + i));
+        partial = _mm_min_sd(partial, _mm_unpackhi_pd(partial, partial));
+        result = _mm_cvtsd_f64(partial);
+    }
+#endif
+    for (; i < n; i++)
+        result = std::min(result, a[i]);
+    return result;
+}
+
+double kernels::max(const double *a, size_t n) {
+    size_t i = 1;
+    double result = a[0];
+#if defined(__AVX2__)
+    if (n >= 4) {
+        __m256d partial = _mm256_loadu_pd(a);
+        for (i = 4; i + 4 <= n; i += 4)
+            partial = _mm256_max_pd(partial, _mm256_loadu_pd(a + i));
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, partial);
+        result = *std::max_element(lanes, lanes + 4);
+    }
+#elif defined(__SSE2__)
+    if (n >= 2) {
+        __m128d partial = _mm_loadu_pd(a);
+        for (i = 2; i + 2 <= n; i += 2)
+            partial = _mm_max_pd(partial, _mm_loadu_pd(a + i));
+        partial = _mm_max_sd(partial, _mm_unpackhi_pd(partial, partial));
+        result = _mm_cvtsd_f64(partial);
+    }
+#endif
+    for (; i < n; i++)
+        result = std::max(result, a[i]);
+    return result;
+}
+
+/* SSE2 has no 64 bit compare, only AVX2 gets a vector loop here */
+int64_t kernels::min(const int64_t *a, size_t n) {
+    size_t i = 1;
+    int64_t result = a[0];
+#if defined(__AVX2__)
+    if (n >= 4) {
+        __m256i partial = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+        for (i = 4; i + 4 <= n; i += 4) {
+            __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            partial = _mm256_blendv_epi8(partial, next, _mm256_cmpgt_epi64(partial, next));
+        }
+        alignas(32) int64_t lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), partial);
+        result = *std::min_element(lanes, lanes + 4);
+    }
+#endif
+    for (; i < n; i++)
+        result = std::min(result, a[i]);
+    return result;
+}
+
+int64_t kernels::max(const int64_t *a, size_t n) {
+    size_t i = 1;
+    int64_t result = a[0];
+#if defined(__AVX2__)
+    if (n >= 4) {
+        __m256i partial = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+        for (i = 4; i + 4 <= n; i += 4) {
+            __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            partial = _mm256_blendv_epi8(partial, next, _mm256_cmpgt_epi64(next, partial));
+        }
+        alignas(32) int64_t lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), partial);
+        result = *std::max_element(lanes, lanes + 4);
+    }
+#endif
+    for (; i < n; i++)
+        result = std::max(result, a[i]);
+    return result;
+}
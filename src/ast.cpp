@@ -1,4 +1,5 @@
 #include <iostream>
+#include <sstream>
 
 #include "ast/ast.hpp"
 #include "ast/print.hpp"
@@ -104,6 +105,33 @@ std::shared_ptr<FunctionCall> FunctionCall::create(std::shared_ptr<Identifier> n
     return ast;
 }
 
+std::shared_ptr<List> List::create(std::vector<std::shared_ptr<Expression>> elements, TokenRange tokens, std::shared_ptr<Node> parent) {
+    std::shared_ptr<List> ast = std::shared_ptr<List>(new List(elements, tokens, parent));
+    for (auto element: elements)
+        element->parent = ast;
+    return ast;
+}
+
+std::shared_ptr<Slice> Slice::create(std::shared_ptr<Expression> start, std::shared_ptr<Expression> stop, TokenRange tokens, std::shared_ptr<Node> parent) {
+    std::shared_ptr<Slice> ast = std::shared_ptr<Slice>(new Slice(start, stop, tokens, parent));
+    if (start)
+        start->parent = ast;
+    if (stop)
+        stop->parent = ast;
+    return ast;
+}
+
+std::shared_ptr<For> For::create(std::shared_ptr<Access> target, std::shared_ptr<Expression> sequence, std::shared_ptr<Block> block, TokenRange tokens, std::shared_ptr<Node> parent) {
+    std::shared_ptr<For> ast = std::shared_ptr<For>(new For(target, sequence, block, tokens, parent));
+    if (target)
+        target->parent = ast;
+    if (sequence)
+        sequence->parent = ast;
+    if (block)
+        block->parent = ast;
+    return ast;
+}
+
 std::string BinaryOp::string_op() {
     switch (op) {
         case Mul: return std::string("Multiply");
@@ -164,7 +192,13 @@ void AstPrinter::visit_unary_op(UnaryOp &node) {
 }
 
 void AstPrinter::visit_number(Number &node) {
-    print_literal(node);
+    /* folded numbers have no literal of their own */
+    std::ostringstream value;
+    if (node.is_integer)
+        value << node.integer;
+    else
+        value << node.number;
+    print_node(value.str().c_str(), node.tokens);
 }
 
 void AstPrinter::visit_string(String &node) {
@@ -209,6 +243,37 @@ void AstPrinter::visit_function_call(FunctionCall &node) {
     decrease_indentation();
 }
 
+void AstPrinter::visit_list(List &node) {
+    print_node("List", node.tokens);
+    increase_indentation();
+    for (auto element: node.elements)
+        element->visit(*this);
+    decrease_indentation();
+}
+
+void AstPrinter::visit_slice(Slice &node) {
+    print_node("Slice", node.tokens);
+    increase_indentation();
+    if (node.start)
+        node.start->visit(*this);
+    else
+        std::cout << indentation << "start\n";
+    if (node.stop)
+        node.stop->visit(*this);
+    else
+        std::cout << indentation << "end\n";
+    decrease_indentation();
+}
+
+void AstPrinter::visit_for_stmt(For &node) {
+    print_node("For", node.tokens);
+    increase_indentation();
+    node.target->visit(*this);
+    node.sequence->visit(*this);
+    node.block->visit(*this);
+    decrease_indentation();
+}
+
 void AstPrinter::visit_function_definition(FunctionDefinition &node) {
     std::string identifier = std::string("FunctionDefinition \"") + node.name->token.literal() + "\"";
     print_node(identifier.c_str(), node.tokens);
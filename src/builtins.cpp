@@ -0,0 +1,212 @@
+#include "runtime/builtins.hpp"
+#include "runtime/array.hpp"
+#include "runtime/heap.hpp"
+
+#include <iostream>
+#include <vector>
+
+using namespace runtime;
+
+static Array *array_argument(const char *builtin, Value value) {
+    if (!value.is_array()) {
+        std::cout << "Error: " << builtin << " expects an array, got " << value.to_string() << std::endl;
+        return NULL;
+    }
+    return static_cast<Array *>(value.heap_object());
+}
+
+static bool length_argument(const char *builtin, Value value, size_t &length) {
+    if (!value.is_int() or value.int_value() < 0 or value.int_value() > MAX_ARRAY_LENGTH) {
+        std::cout << "Error: " << builtin << " expects a length from 0 to " << MAX_ARRAY_LENGTH << ", got " << value.to_string() << std::endl;
+        return false;
+    }
+    length = value.int_value();
+    return true;
+}
+
+/* the elements of array as doubles, converted into storage if they are ints */
+static const double *float64_elements(Array *array, std::vector<double> &storage) {
+    if (array->type == Array::Float64)
+        return array->doubles.data();
+    storage.assign(array->ints.begin(), array->ints.end());
+    return storage.data();
+}
+
+/* both arrays of an element-wise builtin, mixing int64 with float64 gives float64 */
+static bool array_pair(const char *builtin, Value *arguments, Array *&a, Array *&b) {
+    a = array_argument(builtin, arguments[0]);
+    b = a ? array_argument(builtin, arguments[1]) : NULL;
+    if (b == NULL)
+        return false;
+    if (a->length() != b->length()) {
+        std::cout << "Error: " << builtin << " expects arrays of equal length, got " << a->length() << " and " << b->length() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool float64_array(Heap &heap, Value *arguments, Value &result) {
+    size_t length;
+    if (!length_argument("float64_array", arguments[0], length))
+        return false;
+    result = Value(heap.allocate<Array>(Array::Float64, length));
+    return true;
+}
+
+static bool int64_array(Heap &heap, Value *arguments, Value &result) {
+    size_t length;
+    if (!length_argument("int64_array", arguments[0], length))
+        return false;
+    result = Value(heap.allocate<Array>(Array::Int64, length));
+    return true;
+}
+
+static bool arange(Heap &heap, Value *arguments, Value &result) {
+    size_t length;
+    if (!length_argument("arange", arguments[0], length))
+        return false;
+    Array *array = heap.allocate<Array>(Array::Int64, length);
+    for (size_t index = 0; index < length; index++)
+        array->ints[index] = index;
+    result = Value(array);
+    return true;
+}
+
+static bool len(Heap &, Value *arguments, Value &result) {
+    if (arguments[0].is_list()) {
+        result = Value::create_int(arguments[0].list()->elements.size());
+        return true;
+    }
+    Array *array = array_argument("len", arguments[0]);
+    if (array == NULL)
+        return false;
+    result = Value::create_int(array->length());
+    return true;
+}
+
+static bool append(Heap &heap, Value *arguments, Value &) {
+    if (!arguments[0].is_list()) {
+        std::cout << "Error: append expects a list, got " << arguments[0].to_string() << std::endl;
+        return false;
+    }
+    heap.grew(arguments[0].list()->append(arguments[1]));
+    return true;
+}
+
+static bool array_add(Heap &heap, Value *arguments, Value &result) {
+    Array *a, *b;
+    if (!array_pair("array_add", arguments, a, b))
+        return false;
+    if (a->type == Array::Int64 and b->type == Array::Int64) {
+        Array *sum = heap.allocate<Array>(Array::Int64, a->length());
+        kernels::add(a->ints.data(), b->ints.data(), sum->ints.data(), a->length());
+        result = Value(sum);
+        return true;
+    }
+    std::vector<double> a_storage, b_storage;
+    Array *sum = heap.allocate<Array>(Array::Float64, a->length());
+    kernels::add(float64_elements(a, a_storage), float64_elements(b, b_storage), sum->doubles.data(), a->length());
+    result = Value(sum);
+    return true;
+}
+
+static bool array_mul(Heap &heap, Value *arguments, Value &result) {
+    Array *a, *b;
+    if (!array_pair("array_mul", arguments, a, b))
+        return false;
+    if (a->type == Array::Int64 and b->type == Array::Int64) {
+        Array *product = heap.allocate<Array>(Array::Int64, a->length());
+        kernels::mul(a->ints.data(), b->ints.data(), product->ints.data(), a->length());
+        result = Value(product);
+        return true;
+    }
+    std::vector<double> a_storage, b_storage;
+    Array *product = heap.allocate<Array>(Array::Float64, a->length());
+    kernels::mul(float64_elements(a, a_storage), float64_elements(b, b_storage), product->doubles.data(), a->length());
+    result = Value(product);
+    return true;
+}
+
+static bool sum(Heap &, Value *arguments, Value &result) {
+    Array *array = array_argument("sum", arguments[0]);
+    if (array == NULL)
+        return false;
+    if (array->type == Array::Int64)
+        result = Value::create_int(kernels::sum(array->ints.data(), array->length()));
+    else
+        result = Value(kernels::sum(array->doubles.data(), array->length()));
+    return true;
+}
+
+static bool dot(Heap &, Value *arguments, Value &result) {
+    Array *a, *b;
+    if (!array_pair("dot", arguments, a, b))
+        return false;
+    if (a->type == Array::Int64 and b->type == Array::Int64) {
+        result = Value::create_int(kernels::dot(a->ints.data(), b->ints.data(), a->length()));
+        return true;
+    }
+    std::vector<double> a_storage, b_storage;
+    result = Value(kernels::dot(float64_elements(a, a_storage), float64_elements(b, b_storage), a->length()));
+    return true;
+}
+
+static Array *non_empty_array(const char *builtin, Value value) {
+    Array *array = array_argument(builtin, value);
+    if (array and array->length() == 0) {
+        std::cout << "Error: " << builtin << " of an empty array\n";
+        return NULL;
+    }
+    return array;
+}
+
+static bool min(Heap &, Value *arguments, Value &result) {
+    Array *array = non_empty_array("min", arguments[0]);
+    if (array == NULL)
+        return false;
+    if (array->type == Array::Int64)
+        result = Value::create_int(kernels::min(array->ints.data(), array->length()));
+    else
+        result = Value(kernels::min(array->doubles.data(), array->length()));
+    return true;
+}
+
+static bool max(Heap &, Value *arguments, Value &result) {
+    Array *array = non_empty_array("max", arguments[0]);
+    if (array == NULL)
+        return false;
+    if (array->type == Array::Int64)
+        result = Value::create_int(kernels::max(array->ints.data(), array->length()));
+    else
+        result = Value(kernels::max(array->doubles.data(), array->length()));
+    return true;
+}
+
+const Builtin runtime::builtins[] = {
+    {"float64_array", 1, float64_array},
+    {"int64_array", 1, int64_array},
+    {"arange", 1, arange},
+    {"len", 1, len},
+    {"append", 2, append},
+    {"array_add", 2, array_add},
+    {"array_mul", 2, array_mul},
+    {"sum", 1, sum},
+    {"dot", 2, dot},
+    {"min", 1, min},
+    {"max", 1, max},
+};
+
+const size_t runtime::num_builtins = sizeof(builtins) / sizeof(builtins[0]);
+
+ssize_t runtime::find_builtin(Symbol name) {
+    static std::vector<Symbol> symbols;
+    if (symbols.empty()) {
+        for (size_t index = 0; index < num_builtins; index++)
+            symbols.push_back(SymbolTable::global().intern(builtins[index].name));
+    }
+    for (size_t index = 0; index < num_builtins; index++) {
+        if (symbols[index] == name)
+            return index;
+    }
+    return -1;
+}
@@ -1,6 +1,9 @@
 #include "lexer/lexer.hpp"
 #include "parser/parser.hpp"
+#include "ast/fold.hpp"
 #include "runtime/compile.hpp"
+#include "runtime/heap.hpp"
+#include "runtime/environment.hpp"
 
 #include <iostream>
 #include <fstream>
@@ -13,17 +16,54 @@ using namespace std;
 
 int main(int argc, char* argv[])
 {
-    if (argc != 2)
+    char *filepath = NULL;
+    size_t max_depth = DEFAULT_MAX_DEPTH;
+    bool print_stats = false;
+    bool profile_pairs = false;
+    bool superinstructions = true;
+    bool constant_folding = true;
+    bool peephole = true;
+    int optimization_level = 1;
+    const char *dump_ir = "";
+    size_t gc_threshold = DEFAULT_GC_THRESHOLD;
+    double gc_growth_factor = DEFAULT_GC_GROWTH_FACTOR;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0)
+            print_stats = true;
+        else if (strcmp(argv[i], "--profile-pairs") == 0)
+            profile_pairs = true;
+        else if (strcmp(argv[i], "--no-superinstructions") == 0)
+            superinstructions = false;
+        else if (strcmp(argv[i], "--no-constant-folding") == 0)
+            constant_folding = false;
+        else if (strcmp(argv[i], "--no-peephole") == 0)
+            peephole = false;
+        else if (strcmp(argv[i], "-O0") == 0 or strcmp(argv[i], "-O1") == 0 or strcmp(argv[i], "-O2") == 0)
+            optimization_level = argv[i][2] - '0';
+        else if (strcmp(argv[i], "--dump-ir") == 0 and i + 1 < argc)
+            dump_ir = argv[++i];
+        else if (strcmp(argv[i], "--gc-threshold") == 0 and i + 1 < argc)
+            gc_threshold = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--gc-growth") == 0 and i + 1 < argc)
+            gc_growth_factor = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "--max-depth") == 0 and i + 1 < argc)
+            max_depth = strtoul(argv[++i], NULL, 10);
+        else if (filepath == NULL)
+            filepath = argv[i];
+        else
+            filepath = NULL, i = argc;
+    }
+    if (filepath == NULL)
     {
-        printf("Usage: program <file_to_read>\n");
+        printf("Usage: program [--stats] [--profile-pairs] [--no-superinstructions] [--no-constant-folding] [--no-peephole] [-O0|-O1|-O2] [--dump-ir <pass>|all] [--max-depth <calls>] [--gc-threshold <bytes>] [--gc-growth <factor>] <file_to_read>\n");
         return 1;
     }
 
-    ifstream file(argv[1]);
+    ifstream file(filepath);
     shared_ptr<string> code_string = shared_ptr<string>(new string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()));
 
     /* Lex program and print tokens */
-    Lexer lexer(code_string, argv[1]);
+    Lexer lexer(code_string, filepath);
     lexer.parse();
     std::cout << "Lexemes:" << endl;
     lexer.tokens->print();
@@ -33,12 +73,22 @@ int main(int argc, char* argv[])
     /* Parse an expression */
     Parser parser = Parser(lexer.tokens);
     shared_ptr<ast::File> file_ast = parser.parse_file();
+    if (constant_folding) {
+        ast::ConstantFolder folder;
+        file_ast->visit(folder);
+    }
     std::cout << "AST:" << endl;
     file_ast->print();
     std::cout << endl;
 
     /* Compile AST to Bytecode */
     BytecodeCompiler compiler;
+    compiler.superinstructions = superinstructions;
+    compiler.peephole = peephole;
+    ir::PassManager optimizer(optimization_level);
+    optimizer.dump = dump_ir;
+    if (optimization_level > 0)
+        compiler.optimizer = &optimizer;
     file_ast->visit(compiler);
     std::shared_ptr<runtime::Code> code = compiler.code();
     std::cout << "Bytecodes:" << endl;
@@ -55,8 +105,27 @@ int main(int argc, char* argv[])
         class_struct->get()->print();
 
     /* execute code */
-    runtime::Value result = code->run();
+    runtime::Heap heap(gc_threshold, gc_growth_factor);
+    runtime::Environment env(heap, DEFAULT_STACK_SIZE, max_depth);
+    env.profile_pairs = profile_pairs;
+    runtime::Value result = env.run(*code);
     std::cout << "Ran code with result: " << result.to_string() << endl;
 
+    if (print_stats) {
+        std::cout << endl << "Inline caches:" << endl;
+        code->print_stats();
+        for (auto func = compiler.functions.begin(); func != compiler.functions.end(); func++)
+            func->get()->print_stats();
+        for(auto class_struct = compiler.classes.begin(); class_struct != compiler.classes.end(); class_struct++)
+            class_struct->get()->print_stats();
+        std::cout << endl << "Garbage collector:" << endl;
+        heap.stats.print();
+    }
+
+    if (profile_pairs) {
+        std::cout << endl << "Most frequent opcode pairs:" << endl;
+        env.print_pair_profile(20);
+    }
+
     return 0;
 }
\ No newline at end of file
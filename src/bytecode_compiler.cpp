@@ -1,4 +1,6 @@
 #include "runtime/compile.hpp"
+#include "runtime/builtins.hpp"
+#include "runtime/peephole.hpp"
 #include "ast/ast.hpp"
 
 #include <iostream>
@@ -7,58 +9,139 @@
 #include <algorithm>
 
 void BytecodeCompiler::visit_binary_op(ast::BinaryOp &op) {
+    op.left->visit(*this);
+    op.right->visit(*this);
     switch (op.op)
     {
         case ast::BinaryOp::Add:
-            current->bytecodes.push_back(std::unique_ptr<runtime::Bytecode>(new runtime::Add()));
+            current->emit(runtime::Add);
             break;
         case ast::BinaryOp::Min:
-            current->bytecodes.push_back(std::unique_ptr<runtime::Bytecode>(new runtime::Minus()));
+            current->emit(runtime::Minus);
             break;
         case ast::BinaryOp::Div:
-            current->bytecodes.push_back(std::unique_ptr<runtime::Bytecode>(new runtime::Divide()));
+            current->emit(runtime::Divide);
             break;
         case ast::BinaryOp::Mul:
-            current->bytecodes.push_back(std::unique_ptr<runtime::Bytecode>(new runtime::Multiply()));
+            current->emit(runtime::Multiply);
             break;
         default:
             std::cout << "Error: Can't compile " << op.string_op() << " to bytecode\n";
     }
-    op.left->visit(*this);
-    op.right->visit(*this);
+    fuse_superinstruction();
 }
 void BytecodeCompiler::visit_assign_stmt(ast::Assign &node) {
-    current->bytecodes.push_back(std::unique_ptr<runtime::Bytecode>(new runtime::Set()));
+    node.expr->visit(*this);
+    /* the innermost identifier of the location stores the value */
     activate_lvalue();
     node.location->visit(*this);
     deactivate_lvalue();
-    node.expr->visit(*this);
 }
 
 
 void BytecodeCompiler::visit_return_stmt(ast::Return &node) {
+    std::shared_ptr<runtime::Method> method = std::dynamic_pointer_cast<runtime::Method>(current);
+    if (method and symbol_name(method->name) == "__init__") {
+        std::cout << "Error: __init__ of class " << symbol_name(method->class_struct->name) << " must not return a value\n";
+        return;
+    }
     node.expr->visit(*this);
+    /* a call whose result is returned right away reuses the frame */
+    runtime::Opcode last = current->opcode_back(0);
+    if (last == runtime::CallFunction)
+        current->bytecodes[current->instructions.back()] = runtime::TailCallFunction;
+    else if (last == runtime::CallMethod)
+        current->bytecodes[current->instructions.back()] = runtime::TailCallMethod;
+    else
+        current->emit(runtime::Return);
 }
 
 void BytecodeCompiler::visit_identifier(ast::Identifier &node) {
     if (lvalue) {
         if (class_access) {
-            current->bytecodes.push_back(std::unique_ptr<runtime::Bytecode>(new runtime::ObjectAccessLValue(node)));
+            current->emit(runtime::StoreAttribute, current->attribute_cache(node.token.symbol));
+            fuse_superinstruction();
         } else {
             ssize_t var_offset = current->variable_offset_or_create(node);
-            current->bytecodes.push_back(std::unique_ptr<runtime::Bytecode>(new runtime::PushLValue(var_offset)));
+            current->emit(runtime::StoreVariable, var_offset);
         }
     } else if (class_access) {
-        current->bytecodes.push_back(std::unique_ptr<runtime::Bytecode>(new runtime::ObjectAccess(node)));
+        current->emit(runtime::ObjectAccess, current->attribute_cache(node.token.symbol));
+        fuse_superinstruction();
     } else
-        current->bytecodes.push_back(std::unique_ptr<runtime::Bytecode>(new runtime::PushVariable(current->variable_offset_or_create(node))));
+        current->emit(runtime::PushVariable, current->variable_offset_or_create(node));
 }
 
 void BytecodeCompiler::visit_class_access(ast::ClassAccess &node) {
+    /* only the accessed attribute is stored to, the object is loaded */
+    bool store = lvalue;
+    deactivate_lvalue();
+    node.left->visit(*this);
+    lvalue = store;
     activate_class_access();
     node.right->visit(*this); 
     deactivate_class_access();
-    node.left->visit(*this); 
+}
+
+void BytecodeCompiler::visit_index_access(ast::IndexAccess &node) {
+    /* the sequence is loaded, also when the element is stored to */
+    bool store = lvalue;
+    deactivate_lvalue();
+    node.left->visit(*this);
+    /* the index is a plain expression, even inside of an access chain */
+    unsigned int copy_class_access = class_access;
+    class_access = 0;
+    std::shared_ptr<ast::Slice> slice = std::dynamic_pointer_cast<ast::Slice>(node.index);
+    if (slice) {
+        if (slice->start)
+            slice->start->visit(*this);
+        if (slice->stop)
+            slice->stop->visit(*this);
+    } else
+        node.index->visit(*this);
+    class_access = copy_class_access;
+    lvalue = store;
+    if (slice and lvalue)
+        std::cout << "Error: cannot assign to a slice\n";
+    else if (slice)
+        current->emit(runtime::Slice, (slice->start ? 1 : 0) | (slice->stop ? 2 : 0));
+    else
+        current->emit(lvalue ? runtime::IndexStore : runtime::IndexLoad);
+}
+
+void BytecodeCompiler::visit_list(ast::List &list) {
+    bool copy_lvalue = lvalue;
+    unsigned int copy_class_access = class_access;
+    lvalue = false;
+    class_access = 0;
+    for (auto element: list.elements)
+        element->visit(*this);
+    lvalue = copy_lvalue;
+    class_access = copy_class_access;
+    current->emit(runtime::BuildList, list.elements.size());
+}
+
+/*
+ *     <sequence>
+ *     GetIterator
+ * loop:
+ *     ForIter exit
+ *     <store to target>
+ *     <block>
+ *     Jump loop
+ * exit:
+ */
+void BytecodeCompiler::visit_for_stmt(ast::For &node) {
+    node.sequence->visit(*this);
+    current->emit(runtime::GetIterator);
+    size_t loop = current->label();
+    current->emit(runtime::ForIter, 0);
+    activate_lvalue();
+    node.target->visit(*this);
+    deactivate_lvalue();
+    node.block->visit(*this);
+    current->emit(runtime::Jump, loop);
+    current->set_operand(loop, 0, current->label());
 }
 
 void BytecodeCompiler::activate_lvalue() {
@@ -70,7 +153,25 @@ void BytecodeCompiler::deactivate_lvalue() {
 }
 
 void BytecodeCompiler::visit_number(ast::Number &number) {
-    current->bytecodes.push_back(std::unique_ptr<runtime::PushValue>(new runtime::PushValue(runtime::Value(number.number))));
+    runtime::Value constant = number.is_integer ? runtime::Value::create_int(number.integer) : runtime::Value(number.number);
+    current->emit(runtime::PushConstant, current->number_constant(constant));
+}
+
+void BytecodeCompiler::visit_unary_op(ast::UnaryOp &op) {
+    op.expr->visit(*this);
+    current->emit(runtime::Negate);
+}
+
+void BytecodeCompiler::visit_string(ast::String &str) {
+    /* the literal still has its quotes */
+    std::string literal = str.token.literal();
+    current->emit(runtime::PushConstant, current->string_constant(literal.substr(1, literal.size() - 2)));
+}
+
+/* the optimizer fuses while lowering, it only reads generic instructions */
+void BytecodeCompiler::fuse_superinstruction() {
+    if (superinstructions and optimizer == NULL)
+        current->fuse_superinstruction();
 }
 
 std::shared_ptr<runtime::Code> BytecodeCompiler::code() {
@@ -82,7 +183,7 @@ ssize_t runtime::Code::variable_offset_or_create(std::shared_ptr<ast::Identifier
 }
 
 ssize_t runtime::Code::variable_offset_or_create(const ast::Identifier &node) {
-    std::string identifier = node.token.literal();
+    Symbol identifier = node.token.symbol;
     auto it = std::find(variables.begin(), variables.end(), identifier);
 
     if(it != variables.end()) {
@@ -93,9 +194,10 @@ ssize_t runtime::Code::variable_offset_or_create(const ast::Identifier &node) {
     }
 }
 ssize_t runtime::Method::variable_offset_or_create(const ast::Identifier &node) {
-    std::string identifier = node.token.literal();
+    static const Symbol self = SymbolTable::global().intern("self");
+    Symbol identifier = node.token.symbol;
 
-    if (identifier == std::string("self"))
+    if (identifier == self)
         return 0;
 
     /* First look for identifier in parameters */
@@ -116,7 +218,7 @@ ssize_t runtime::Method::variable_offset_or_create(const ast::Identifier &node)
 
 
 ssize_t runtime::Function::variable_offset_or_create(const ast::Identifier &node) {
-    std::string identifier = node.token.literal();
+    Symbol identifier = node.token.symbol;
 
     /* First look for identifier in parameters */
     auto pit = std::find(parameters.begin(), parameters.end(), identifier);
@@ -135,8 +237,11 @@ ssize_t runtime::Function::variable_offset_or_create(const ast::Identifier &node
 }
 
 void BytecodeCompiler::visit_block_stmt(ast::Block &block) {
-    for(auto stmt = block.statements.rbegin(); stmt != block.statements.rend(); stmt++) {
+    for(auto stmt = block.statements.begin(); stmt != block.statements.end(); stmt++) {
         stmt->get()->visit(*this);
+        /* the value of an expression statement is not used */
+        if (std::dynamic_pointer_cast<ast::Expression>(*stmt))
+            current->emit(runtime::Pop);
     }
 }
 
@@ -148,6 +253,33 @@ void BytecodeCompiler::visit_file(ast::File &file) {
         class_->get()->visit(*this);
     }
     file.code->visit(*this);
+    /* a script without return evaluates to its last expression statement */
+    if (current->opcode_back(0) == runtime::Pop) {
+        current->drop_back(1);
+        current->emit(runtime::Return);
+    }
+    current->finish();
+    for (auto function: functions)
+        function->finish();
+    for (auto class_struct: classes) {
+        for (auto method: class_struct->methods)
+            method->finish();
+    }
+    /* functions only call those defined before them, the script comes last */
+    std::vector<runtime::Code *> codes;
+    for (auto function: functions)
+        codes.push_back(function.get());
+    for (auto class_struct: classes) {
+        for (auto method: class_struct->methods)
+            codes.push_back(method.get());
+    }
+    codes.push_back(current.get());
+    if (optimizer)
+        optimizer->run(codes, superinstructions);
+    if (peephole) {
+        for (runtime::Code *code: codes)
+            runtime::optimize_peephole(*code, superinstructions);
+    }
 }
 
 void BytecodeCompiler::visit_function_definition(ast::FunctionDefinition &ast_func) {
@@ -161,30 +293,63 @@ void BytecodeCompiler::visit_function_definition(ast::FunctionDefinition &ast_fu
 
 void BytecodeCompiler::visit_function_call(ast::FunctionCall &call) {
     if (class_access) {
-        current->bytecodes.push_back(std::unique_ptr<runtime::CallMethod>(new runtime::CallMethod(call.name->token.literal(), call.parameters.size())));
+        visit_parameters(call);
+        current->emit(runtime::CallMethod, current->method_cache(call.name->token.symbol), call.parameters.size());
     } else {
         std::shared_ptr<runtime::Function> func = find_function(call);
         if (func == NULL) {
-            visit_constructor(call, call.name->token.literal());
+            ssize_t builtin = runtime::find_builtin(call.name->token.symbol);
+            if (builtin >= 0)
+                visit_builtin(call, builtin);
+            else
+                visit_constructor(call, call.name->token.symbol);
             return;
         }
-        current->bytecodes.push_back(std::unique_ptr<runtime::CallFunction>(new runtime::CallFunction(func)));
-    }
-    for (auto parameter = call.parameters.begin(); parameter != call.parameters.end(); parameter++) {
-        parameter->get()->visit(*this);
+        if (call.parameters.size() != func->parameters.size()) {
+            std::cout << "Error: function " << symbol_name(func->name) << " takes " << func->parameters.size() << " parameters, got " << call.parameters.size() << std::endl;
+            return;
+        }
+        visit_parameters(call);
+        current->emit(runtime::CallFunction, current->function_index(func));
     }
 }
 
-void BytecodeCompiler::visit_constructor(ast::FunctionCall &call, std::string name) {
+void BytecodeCompiler::visit_constructor(ast::FunctionCall &call, Symbol name) {
     std::shared_ptr<runtime::ClassStruct> class_struct = find_class(name);
     if (class_struct == NULL)  {
-        std::cout << "Error: function " << name << " was used before it was defined\n";
+        std::cout << "Error: function " << symbol_name(name) << " was used before it was defined\n";
+        return;
+    }
+    /* the arguments of __init__ are only known once it was compiled */
+    runtime::Method *init = class_struct->constructor();
+    if (init and call.parameters.size() != init->parameters.size()) {
+        std::cout << "Error: class " << symbol_name(name) << " takes " << init->parameters.size() << " parameters, got " << call.parameters.size() << std::endl;
         return;
     }
-    current->bytecodes.push_back(std::unique_ptr<runtime::CallConstructor>(new runtime::CallConstructor(class_struct)));
+    visit_parameters(call);
+    current->emit(runtime::CallConstructor, current->class_index(class_struct));
+}
+
+void BytecodeCompiler::visit_builtin(ast::FunctionCall &call, size_t builtin) {
+    if (call.parameters.size() != runtime::builtins[builtin].num_parameters) {
+        std::cout << "Error: builtin " << runtime::builtins[builtin].name << " takes " << runtime::builtins[builtin].num_parameters << " parameters, got " << call.parameters.size() << std::endl;
+        return;
+    }
+    visit_parameters(call);
+    current->emit(runtime::CallBuiltin, builtin, call.parameters.size());
+}
+
+void BytecodeCompiler::visit_parameters(ast::FunctionCall &call) {
+    /* parameters are plain expressions, even inside of an (l)value access chain */
+    bool copy_lvalue = lvalue;
+    unsigned int copy_class_access = class_access;
+    lvalue = false;
+    class_access = 0;
     for (auto parameter = call.parameters.begin(); parameter != call.parameters.end(); parameter++) {
         parameter->get()->visit(*this);
     }
+    lvalue = copy_lvalue;
+    class_access = copy_class_access;
 }
 
 void BytecodeCompiler::visit_class_definition(ast::ClassDefinition &class_definition) {
@@ -201,14 +366,19 @@ void BytecodeCompiler::visit_class_definition(ast::ClassDefinition &class_defini
 void BytecodeCompiler::visit_method_definition(ast::MethodDefinition &method_definition) {
     std::shared_ptr<runtime::ClassStruct> class_struct = std::dynamic_pointer_cast<runtime::ClassStruct>(current);
     if (class_struct == NULL) {
-        std::cout << "Error: method " << method_definition.name->token.literal() << " is not in class scope\n";
+        std::cout << "Error: method " << symbol_name(method_definition.name->token.symbol) << " is not in class scope\n";
         return;
     }
     std::shared_ptr<runtime::Method> method = std::shared_ptr<runtime::Method>(new runtime::Method(method_definition, class_struct));
-    class_struct->methods.push_back(method);
+    class_struct->add_method(method);
     std::shared_ptr<runtime::Code> copy_current = current;
     current = method;
     method_definition.block->visit(*this);
+    /* constructors hand the new object back to the caller */
+    if (symbol_name(method->name) == "__init__") {
+        current->emit(runtime::PushVariable, 0);
+        current->emit(runtime::Return);
+    }
     current = copy_current;
 }
 
@@ -219,15 +389,15 @@ std::shared_ptr<runtime::Function> BytecodeCompiler::find_function(ast::Function
         return NULL;
     }
     for (auto it = functions.begin(); it != functions.end(); it++) {
-        if (it->get()->name == fname->token.literal()) 
+        if (it->get()->name == fname->token.symbol)
             return *it;
     }
     return NULL;
 }
 
-std::shared_ptr<runtime::ClassStruct> BytecodeCompiler::find_class(const std::string &name) {
+std::shared_ptr<runtime::ClassStruct> BytecodeCompiler::find_class(Symbol name) {
     for (auto it = classes.begin(); it != classes.end(); it++) {
-        if (it->get()->name == name) 
+        if (it->get()->name == name)
             return *it;
     }
     return NULL;
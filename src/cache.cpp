@@ -0,0 +1,62 @@
+#include "runtime/cache.hpp"
+#include "runtime/code.hpp"
+
+#include <iostream>
+
+using namespace runtime;
+
+Value AttributeCache::load_miss(Object *obj) {
+    misses++;
+    size_t slot = obj->shape->lookup(name);
+    if (slot == Shape::NOT_FOUND)
+        return Value::create_void();
+    remember(obj->shape, slot, NULL);
+    return obj->slots[slot];
+}
+
+size_t AttributeCache::store_miss(Object *obj, Value value) {
+    misses++;
+    Shape *shape = obj->shape;
+    size_t grown = obj->set_attribute(name, value);
+    remember(shape, obj->shape->lookup(name), obj->shape != shape ? obj->shape : NULL);
+    return grown;
+}
+
+void AttributeCache::remember(Shape *shape, size_t slot, Shape *transition) {
+    if (megamorphic)
+        return;
+    if (size == POLYMORPHIC_CACHE_SIZE) {
+        megamorphic = true;
+        size = 0;
+        return;
+    }
+    entries[size++] = Entry{shape, slot, transition};
+}
+
+const char *AttributeCache::state() const {
+    if (megamorphic)
+        return "megamorphic";
+    switch (size) {
+        case 0: return "uninitialized";
+        case 1: return "monomorphic";
+        default: return "polymorphic";
+    }
+}
+
+void AttributeCache::print_stats() const {
+    std::cout << "<" << symbol_name(name) << "> " << state() << ", " << hits << " hits, " << misses << " misses\n";
+}
+
+Method *MethodCache::lookup_miss(ClassStruct *receiver_class) {
+    misses++;
+    Method *resolved = receiver_class->find_method(name);
+    if (resolved) {
+        class_struct = receiver_class;
+        method = resolved;
+    }
+    return resolved;
+}
+
+void MethodCache::print_stats() const {
+    std::cout << symbol_name(name) << "() " << (class_struct ? "monomorphic" : "uninitialized") << ", " << hits << " hits, " << misses << " misses\n";
+}
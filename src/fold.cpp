@@ -0,0 +1,208 @@
+#include "ast/fold.hpp"
+#include "runtime/value.hpp"
+
+#include <vector>
+
+using namespace ast;
+
+/* same results as the interpreter's arithmetic on numbers */
+static runtime::Value evaluate(BinaryOp::Operation op, runtime::Value a, runtime::Value b) {
+    switch (op) {
+        case BinaryOp::Add:
+            if (a.is_int() and b.is_int())
+                return runtime::Value::create_int(a.int_value() + b.int_value());
+            return runtime::Value(a.number() + b.number());
+        case BinaryOp::Min:
+            return runtime::Value::minus(a, b);
+        case BinaryOp::Div:
+            return runtime::Value::div(a, b);
+        case BinaryOp::Mul:
+            return runtime::Value::mul(a, b);
+    }
+    return runtime::Value::create_void();
+}
+
+static runtime::Value value_of(const Number &number) {
+    return number.is_integer ? runtime::Value::create_int(number.integer) : runtime::Value(number.number);
+}
+
+static std::shared_ptr<Number> number_node(runtime::Value value, TokenRange tokens, std::shared_ptr<Node> parent) {
+    if (value.is_int())
+        return std::shared_ptr<Number>(new Number(value.number(), value.int_value(), true, tokens, parent));
+    return std::shared_ptr<Number>(new Number(value.number(), 0, false, tokens, parent));
+}
+
+static bool is_int_literal(std::shared_ptr<Expression> expression, int64_t integer) {
+    std::shared_ptr<Number> number = std::dynamic_pointer_cast<Number>(expression);
+    return number and number->is_integer and number->integer == integer;
+}
+
+/* expressions that give a number unless they fail */
+static bool is_numeric(std::shared_ptr<Expression> expression) {
+    if (std::dynamic_pointer_cast<Number>(expression) or std::dynamic_pointer_cast<UnaryOp>(expression))
+        return true;
+    std::shared_ptr<BinaryOp> op = std::dynamic_pointer_cast<BinaryOp>(expression);
+    if (op == NULL)
+        return false;
+    /* only + also concatenates strings */
+    return op->op != BinaryOp::Add or (is_numeric(op->left) and is_numeric(op->right));
+}
+
+static void count_assignments(Block &block, std::unordered_map<Symbol, size_t> &assignments) {
+    for (auto statement: block.statements) {
+        if (std::shared_ptr<Assign> assign = std::dynamic_pointer_cast<Assign>(statement)) {
+            if (std::shared_ptr<Identifier> local = std::dynamic_pointer_cast<Identifier>(assign->location))
+                assignments[local->token.symbol]++;
+        } else if (std::shared_ptr<For> loop = std::dynamic_pointer_cast<For>(statement)) {
+            if (std::shared_ptr<Identifier> local = std::dynamic_pointer_cast<Identifier>(loop->target))
+                assignments[local->token.symbol]++;
+            count_assignments(*loop->block, assignments);
+        }
+    }
+}
+
+std::shared_ptr<Expression> ConstantFolder::fold(std::shared_ptr<Expression> expression) {
+    replacement = NULL;
+    expression->visit(*this);
+    std::shared_ptr<Expression> folded = replacement ? replacement : expression;
+    replacement = NULL;
+    return folded;
+}
+
+void ConstantFolder::walk(std::shared_ptr<Node> node) {
+    node->visit(*this);
+    replacement = NULL;
+}
+
+void ConstantFolder::visit_binary_op(BinaryOp &op) {
+    op.left = fold(op.left);
+    op.right = fold(op.right);
+    std::shared_ptr<Number> left = std::dynamic_pointer_cast<Number>(op.left);
+    std::shared_ptr<Number> right = std::dynamic_pointer_cast<Number>(op.right);
+    if (left and right) {
+        replacement = number_node(evaluate(op.op, value_of(*left), value_of(*right)), op.tokens, op.parent);
+        return;
+    }
+    /* x + 0 is kept, it turns -0.0 into 0.0 */
+    if (op.op == BinaryOp::Mul and is_int_literal(op.right, 1) and is_numeric(op.left))
+        replacement = op.left;
+    else if (op.op == BinaryOp::Mul and is_int_literal(op.left, 1) and is_numeric(op.right))
+        replacement = op.right;
+    else if (op.op == BinaryOp::Min and is_int_literal(op.right, 0) and is_numeric(op.left))
+        replacement = op.left;
+}
+
+void ConstantFolder::visit_unary_op(UnaryOp &op) {
+    op.expr = fold(op.expr);
+    if (std::shared_ptr<Number> number = std::dynamic_pointer_cast<Number>(op.expr))
+        replacement = number_node(runtime::Value::negate(value_of(*number)), op.tokens, op.parent);
+}
+
+void ConstantFolder::visit_identifier(Identifier &identifier) {
+    auto constant = constants.find(identifier.token.symbol);
+    if (constant != constants.end()) {
+        const Number &number = *constant->second;
+        replacement = std::shared_ptr<Number>(new Number(number.number, number.integer, number.is_integer, identifier.Access::tokens, identifier.Access::parent));
+    }
+}
+
+void ConstantFolder::visit_class_access(ClassAccess &access) {
+    /* the attribute name is no local, only parameters of calls are folded */
+    walk(access.left);
+    walk(access.right);
+}
+
+void ConstantFolder::visit_index_access(IndexAccess &access) {
+    walk(access.left);
+    if (std::shared_ptr<Slice> slice = std::dynamic_pointer_cast<Slice>(access.index)) {
+        if (slice->start)
+            slice->start = fold(slice->start);
+        if (slice->stop)
+            slice->stop = fold(slice->stop);
+    } else
+        access.index = fold(access.index);
+}
+
+void ConstantFolder::visit_function_call(FunctionCall &call) {
+    for (auto &parameter: call.parameters)
+        parameter = fold(parameter);
+}
+
+void ConstantFolder::visit_list(List &list) {
+    for (auto &element: list.elements)
+        element = fold(element);
+}
+
+void ConstantFolder::visit_return_stmt(Return &node) {
+    node.expr = fold(node.expr);
+}
+
+void ConstantFolder::visit_assign_stmt(Assign &node) {
+    node.expr = fold(node.expr);
+    /* a local is stored to, anything else is an access chain that is loaded */
+    if (!std::dynamic_pointer_cast<Identifier>(node.location))
+        walk(node.location);
+}
+
+void ConstantFolder::visit_for_stmt(For &node) {
+    node.sequence = fold(node.sequence);
+    if (!std::dynamic_pointer_cast<Identifier>(node.target))
+        walk(node.target);
+    loop_depth++;
+    node.block->visit(*this);
+    loop_depth--;
+}
+
+void ConstantFolder::visit_block_stmt(Block &block) {
+    std::vector<std::shared_ptr<Statement>> statements;
+    for (auto statement: block.statements) {
+        if (std::shared_ptr<Expression> expression = std::dynamic_pointer_cast<Expression>(statement)) {
+            statements.push_back(fold(expression));
+            continue;
+        }
+        statement->visit(*this);
+        statements.push_back(statement);
+        /*
+         * Outside of loops the single assignment runs before every later
+         * use. The store itself is kept for uses that cannot take a
+         * number, like the object of an attribute access.
+         */
+        std::shared_ptr<Assign> assign = std::dynamic_pointer_cast<Assign>(statement);
+        std::shared_ptr<Identifier> local = assign ? std::dynamic_pointer_cast<Identifier>(assign->location) : NULL;
+        std::shared_ptr<Number> constant = assign ? std::dynamic_pointer_cast<Number>(assign->expr) : NULL;
+        if (local and constant and loop_depth == 0 and assignments[local->token.symbol] == 1 and !parameters.count(local->token.symbol))
+            constants[local->token.symbol] = constant;
+    }
+    block.statements = statements;
+}
+
+void ConstantFolder::fold_scope(std::shared_ptr<Block> block, const std::vector<std::shared_ptr<Identifier>> &scope_parameters) {
+    constants.clear();
+    assignments.clear();
+    parameters.clear();
+    for (auto parameter: scope_parameters)
+        parameters.insert(parameter->token.symbol);
+    count_assignments(*block, assignments);
+    block->visit(*this);
+}
+
+void ConstantFolder::visit_function_definition(FunctionDefinition &function) {
+    fold_scope(function.block, function.parameters);
+}
+
+void ConstantFolder::visit_method_definition(MethodDefinition &method) {
+    fold_scope(method.block, method.parameters);
+}
+
+void ConstantFolder::visit_class_definition(ClassDefinition &class_definition) {
+    for (auto method: class_definition.methods)
+        method->visit(*this);
+}
+
+void ConstantFolder::visit_file(File &file) {
+    for (auto function: file.functions)
+        function->visit(*this);
+    for (auto class_definition: file.classes)
+        class_definition->visit(*this);
+    fold_scope(file.code, {});
+}
@@ -0,0 +1,63 @@
+#include "runtime/heap.hpp"
+#include "runtime/environment.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+using namespace runtime;
+
+Heap::~Heap() {
+    while (objects) {
+        HeapObject *next = objects->next;
+        delete objects;
+        objects = next;
+    }
+}
+
+void Heap::collect(Environment &env) {
+    auto start = std::chrono::steady_clock::now();
+
+    /* mark everything reachable from the stack */
+    for (Value *value = env.stack.data(); value != env.sp; value++)
+        mark(*value);
+    while (!gray.empty()) {
+        HeapObject *obj = gray.back();
+        gray.pop_back();
+        obj->trace(*this);
+    }
+    sweep();
+
+    next_collection = std::max(threshold, static_cast<size_t>(stats.live_bytes * growth_factor));
+    bytes_allocated = stats.live_bytes;
+
+    std::chrono::duration<double, std::milli> pause = std::chrono::steady_clock::now() - start;
+    stats.collections++;
+    stats.total_pause_ms += pause.count();
+    stats.max_pause_ms = std::max(stats.max_pause_ms, pause.count());
+}
+
+void Heap::sweep() {
+    stats.live_objects = 0;
+    stats.live_bytes = 0;
+    HeapObject **link = &objects;
+    while (*link) {
+        HeapObject *obj = *link;
+        if (obj->marked) {
+            obj->marked = false;
+            stats.live_objects++;
+            stats.live_bytes += obj->size();
+            link = &obj->next;
+        } else {
+            *link = obj->next;
+            stats.freed_objects++;
+            delete obj;
+        }
+    }
+}
+
+void HeapStats::print() const {
+    std::cout << collections << " collections, " << freed_objects << " objects freed\n";
+    std::cout << "pause: " << total_pause_ms << "ms total, " << max_pause_ms << "ms max\n";
+    std::cout << "live after last collection: " << live_objects << " objects, " << live_bytes << " bytes\n";
+}
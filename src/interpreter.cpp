@@ -0,0 +1,615 @@
+#include "runtime/array.hpp"
+#include "runtime/builtins.hpp"
+#include "runtime/bytecode.hpp"
+#include "runtime/code.hpp"
+#include "runtime/environment.hpp"
+#include "runtime/heap.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace runtime;
+
+/* guard of the double instructions, int with int stays on the int path */
+static inline bool mixed_numbers(Value a, Value b) {
+    return a.is_number() and b.is_number() and (a.is_double() or b.is_double());
+}
+
+/* negative indices count from the end like in python */
+static bool element_index(size_t length, Value index, size_t &element) {
+    int64_t position = index.is_int() ? index.int_value() : -1;
+    if (index.is_int() and position < 0)
+        position += length;
+    if (!index.is_int() or position < 0 or static_cast<size_t>(position) >= length) {
+        std::cout << "Error: index " << index.to_string() << " out of range for a sequence of length " << length << std::endl;
+        return false;
+    }
+    element = position;
+    return true;
+}
+
+bool Environment::is_empty() {
+    return sp == stack.data();
+}
+
+void Environment::print_stack() {
+    std::cout << "Stack:\n";
+    for (Value *v = stack.data(); v != sp; v++)
+        std::cout << v->to_string() << std::endl;
+}
+
+void Environment::safepoint() {
+    if (heap->should_collect())
+        heap->collect(*this);
+}
+
+void Environment::print_pair_profile(size_t max_pairs) {
+    std::vector<size_t> pairs;
+    for (size_t pair = 0; pair < pair_counts.size(); pair++) {
+        if (pair_counts[pair] and pair / NumOpcodes != NumOpcodes)
+            pairs.push_back(pair);
+    }
+    std::sort(pairs.begin(), pairs.end(), [&](size_t a, size_t b) { return pair_counts[a] > pair_counts[b]; });
+    if (pairs.size() > max_pairs)
+        pairs.resize(max_pairs);
+    for (size_t pair: pairs)
+        std::cout << pair_counts[pair] << "\t" << opcode_info[pair / NumOpcodes].name << " " << opcode_info[pair % NumOpcodes].name << std::endl;
+}
+
+Value Environment::run(Code &code) {
+    size_t entry_depth = frames.size();
+    if (!push_frame(code, sp, NULL) or !execute(entry_depth))
+        return Value::create_void();
+    return pop();
+}
+
+/* a new frame must not reach into the locals of the running one */
+bool Environment::check_frame(Value *frame) {
+    Value *lowest = frames.empty() ? stack.data() : frames.back().base + frames.back().code->frame_size;
+    if (frame >= lowest)
+        return true;
+    std::cout << "Error: call takes more arguments than were passed\n";
+    return false;
+}
+
+bool Environment::push_frame(Code &code, Value *frame, uint8_t *return_ip) {
+    if (frames.size() >= max_depth) {
+        std::cout << "Error: maximum call depth of " << max_depth << " exceeded\n";
+        return false;
+    }
+    if (!check_frame(frame))
+        return false;
+    Value *locals_end = frame + code.frame_size;
+    if (locals_end + code.max_stack > stack.data() + stack.size()) {
+        std::cout << "Error: stack overflow\n";
+        return false;
+    }
+    if (!frames.empty())
+        frames.back().ip = return_ip;
+    /* init variables on stack, the arguments are already in place */
+    std::fill(sp, locals_end, Value::create_void());
+    sp = locals_end;
+    base = frame;
+    frames.push_back(Frame{&code, code.bytecodes.data(), frame});
+    return true;
+}
+
+/* the method of a call site is only known at run time, so is whether its arguments fit */
+bool Environment::check_arguments(Method &method, size_t num_parameters) {
+    if (method.parameters.size() == num_parameters)
+        return true;
+    std::cout << "Error: method " << symbol_name(method.name) << " of class " << symbol_name(method.class_struct->name) << " takes " << method.parameters.size() << " parameters, got " << num_parameters << std::endl;
+    return false;
+}
+
+/* runs code in the running frame, the arguments are moved to its start */
+bool Environment::replace_frame(Code &code, Value *arguments) {
+    Value *frame = frames.back().base;
+    if (!check_frame(arguments))
+        return false;
+    Value *locals_end = frame + code.frame_size;
+    if (locals_end + code.max_stack > stack.data() + stack.size()) {
+        std::cout << "Error: stack overflow\n";
+        return false;
+    }
+    Value *arguments_end = std::copy(arguments, sp, frame);
+    std::fill(arguments_end, locals_end, Value::create_void());
+    sp = locals_end;
+    frames.back().code = &code;
+    frames.back().ip = code.bytecodes.data();
+    return true;
+}
+
+void Environment::unwind(size_t entry_depth) {
+    sp = frames[entry_depth].base;
+    frames.erase(frames.begin() + entry_depth, frames.end());
+    base = frames.empty() ? stack.data() : frames.back().base;
+}
+
+/*
+ * The top of the operand stack is kept in the local tos instead of memory,
+ * so arithmetic and loads mostly work on a register. The memory stack holds
+ * everything below it: a push spills tos to *sp, a pop reloads it from
+ * there. Since the first push of a frame spills whatever tos held before,
+ * the memory part keeps the same size as the logical stack and sp - base
+ * stays meaningful. tos is spilled before calls and collections, which
+ * only look at the memory stack. Since the compiler sized the frame for
+ * its deepest stack, none of this needs bounds checks.
+ */
+bool Environment::execute(size_t entry_depth) {
+    Code *code;
+    uint8_t *ip;
+    Value tos = Value::create_void();
+    auto load_frame = [&]() {
+        Frame &frame = frames.back();
+        code = frame.code;
+        ip = frame.ip;
+        base = frame.base;
+    };
+    auto spill = [&]() {
+        *sp++ = tos;
+    };
+    auto reload = [&]() {
+        tos = *--sp;
+    };
+    /* tos may be a heap value that is referenced from nowhere else */
+    auto collect = [&]() {
+        spill();
+        safepoint();
+        sp--;
+    };
+    load_frame();
+    Opcode previous = NumOpcodes;
+    if (profile_pairs)
+        pair_counts.resize((NumOpcodes + 1) * NumOpcodes);
+    while (true) {
+        uint8_t *instruction = ip;
+        Opcode op = static_cast<Opcode>(*ip);
+        const uint8_t *operands = ip + 1;
+        ip += instruction_size(op);
+        if (profile_pairs) {
+            pair_counts[previous * NumOpcodes + op]++;
+            previous = op;
+        }
+        switch (op) {
+            case Add: {
+                Value left = *--sp;
+                if (left.is_int() and tos.is_int())
+                    *instruction = AddInt;
+                else if (mixed_numbers(left, tos))
+                    *instruction = AddNumber;
+                else if (left.is_string() and tos.is_string())
+                    *instruction = AddString;
+                tos = Value::add(*heap, left, tos);
+                collect();
+                break;
+            }
+            case Minus: {
+                Value left = *--sp;
+                if (left.is_int() and tos.is_int())
+                    *instruction = MinusInt;
+                else if (mixed_numbers(left, tos))
+                    *instruction = MinusNumber;
+                tos = Value::minus(left, tos);
+                break;
+            }
+            case Divide: {
+                Value left = *--sp;
+                if (left.is_number() and tos.is_number())
+                    *instruction = DivideNumber;
+                tos = Value::div(left, tos);
+                break;
+            }
+            case Multiply: {
+                Value left = *--sp;
+                if (left.is_int() and tos.is_int())
+                    *instruction = MultiplyInt;
+                else if (mixed_numbers(left, tos))
+                    *instruction = MultiplyNumber;
+                tos = Value::mul(left, tos);
+                break;
+            }
+            case Negate:
+                tos = Value::negate(tos);
+                break;
+            /* guards of quickened instructions rewrite and rerun the generic form */
+            case AddInt:
+                if (!sp[-1].is_int() or !tos.is_int()) {
+                    *instruction = Add;
+                    ip = instruction;
+                    break;
+                }
+                tos = Value::create_int(sp[-1].int_value() + tos.int_value());
+                sp--;
+                break;
+            case AddNumber:
+                if (!mixed_numbers(sp[-1], tos)) {
+                    *instruction = Add;
+                    ip = instruction;
+                    break;
+                }
+                tos = Value(sp[-1].number() + tos.number());
+                sp--;
+                break;
+            case AddString:
+                if (!sp[-1].is_string() or !tos.is_string()) {
+                    *instruction = Add;
+                    ip = instruction;
+                    break;
+                }
+                tos = Value(String::concat(*heap, sp[-1].string(), tos.string()));
+                sp--;
+                collect();
+                break;
+            case MinusInt:
+                if (!sp[-1].is_int() or !tos.is_int()) {
+                    *instruction = Minus;
+                    ip = instruction;
+                    break;
+                }
+                tos = Value::create_int(sp[-1].int_value() - tos.int_value());
+                sp--;
+                break;
+            case MinusNumber:
+                if (!mixed_numbers(sp[-1], tos)) {
+                    *instruction = Minus;
+                    ip = instruction;
+                    break;
+                }
+                tos = Value(sp[-1].number() - tos.number());
+                sp--;
+                break;
+            case DivideNumber:
+                if (!sp[-1].is_number() or !tos.is_number()) {
+                    *instruction = Divide;
+                    ip = instruction;
+                    break;
+                }
+                tos = Value(sp[-1].number() / tos.number());
+                sp--;
+                break;
+            case MultiplyInt: {
+                int64_t product;
+                if (!sp[-1].is_int() or !tos.is_int()) {
+                    *instruction = Multiply;
+                    ip = instruction;
+                    break;
+                }
+                if (__builtin_mul_overflow(sp[-1].int_value(), tos.int_value(), &product))
+                    tos = Value(sp[-1].number() * tos.number());
+                else
+                    tos = Value::create_int(product);
+                sp--;
+                break;
+            }
+            case MultiplyNumber:
+                if (!mixed_numbers(sp[-1], tos)) {
+                    *instruction = Multiply;
+                    ip = instruction;
+                    break;
+                }
+                tos = Value(sp[-1].number() * tos.number());
+                sp--;
+                break;
+            case PushConstant:
+                spill();
+                tos = code->constants[read_operand(operands)];
+                break;
+            case PushVariable:
+                spill();
+                tos = base[read_operand(operands)];
+                break;
+            case StoreVariable:
+                base[read_operand(operands)] = tos;
+                reload();
+                break;
+            case StoreVariableKeep:
+                base[read_operand(operands)] = tos;
+                break;
+            case Pop:
+                reload();
+                break;
+            case IndexLoad: {
+                size_t element;
+                if (sp[-1].is_list()) {
+                    List *list = sp[-1].list();
+                    if (!element_index(list->elements.size(), tos, element)) {
+                        unwind(entry_depth);
+                        return false;
+                    }
+                    tos = list->elements[element];
+                } else {
+                    Array *array = sp[-1].array();
+                    if (array == NULL or !element_index(array->length(), tos, element)) {
+                        unwind(entry_depth);
+                        return false;
+                    }
+                    tos = array->load(element);
+                }
+                sp--;
+                break;
+            }
+            case IndexStore: {
+                /* value, sequence, index */
+                size_t element;
+                if (sp[-1].is_list()) {
+                    List *list = sp[-1].list();
+                    if (!element_index(list->elements.size(), tos, element)) {
+                        unwind(entry_depth);
+                        return false;
+                    }
+                    list->elements[element] = sp[-2];
+                } else {
+                    Array *array = sp[-1].array();
+                    if (array == NULL or !element_index(array->length(), tos, element) or !array->store(element, sp[-2])) {
+                        unwind(entry_depth);
+                        return false;
+                    }
+                }
+                sp -= 2;
+                reload();
+                break;
+            }
+            case BuildList: {
+                spill();
+                Value *elements = sp - read_operand(operands);
+                tos = Value(heap->allocate<List>(std::vector<Value>(elements, sp)));
+                sp = elements;
+                collect();
+                break;
+            }
+            case Slice: {
+                Operand bounds = read_operand(operands);
+                spill();
+                Value stop = bounds & 2 ? *--sp : Value::create_void();
+                Value start = bounds & 1 ? *--sp : Value::create_void();
+                tos = Value::slice(*heap, sp[-1], start, stop);
+                sp--;
+                collect();
+                break;
+            }
+            /* the loop keeps the sequence and the position of the next element on the stack */
+            case GetIterator:
+                if (!tos.is_list() and !tos.is_array()) {
+                    std::cout << "Error: cannot iterate over " << tos.to_string() << std::endl;
+                    unwind(entry_depth);
+                    return false;
+                }
+                spill();
+                tos = Value::create_int(0);
+                break;
+            case ForIter: {
+                Value sequence = sp[-1];
+                size_t position = tos.int_value();
+                size_t length = sequence.is_list() ? sequence.list()->elements.size() : static_cast<Array *>(sequence.heap_object())->length();
+                if (position >= length) {
+                    sp--;
+                    reload();
+                    ip = code->bytecodes.data() + read_operand(operands);
+                    break;
+                }
+                spill();
+                sp[-1] = Value::create_int(position + 1);
+                tos = sequence.is_list() ? sequence.list()->elements[position] : static_cast<Array *>(sequence.heap_object())->load(position);
+                break;
+            }
+            case Jump:
+                ip = code->bytecodes.data() + read_operand(operands);
+                break;
+            case CallBuiltin: {
+                const Builtin &builtin = builtins[read_operand(operands)];
+                spill();
+                Value *arguments = sp - read_operand(operands + sizeof(Operand));
+                Value result = Value::create_void();
+                if (!builtin.function(*heap, arguments, result)) {
+                    unwind(entry_depth);
+                    return false;
+                }
+                /* the result replaces the arguments */
+                sp = arguments;
+                tos = result;
+                collect();
+                break;
+            }
+            case ReturnVoid:
+                tos = Value::create_void();
+                /* fall through */
+            case Return:
+                /* the return value replaces the frame in the caller's stack */
+                *base = tos;
+                sp = base + 1;
+                frames.pop_back();
+                if (frames.size() == entry_depth) {
+                    base = frames.empty() ? stack.data() : frames.back().base;
+                    return true;
+                }
+                load_frame();
+                reload();
+                break;
+            case ObjectAccess: {
+                Object *obj = tos.object();
+                if (obj == NULL) {
+                    unwind(entry_depth);
+                    return false;
+                }
+                AttributeCache &cache = code->attribute_caches[read_operand(operands)];
+                tos = cache.load(obj);
+                if (cache.is_monomorphic())
+                    *instruction = ObjectAccessMonomorphic;
+                break;
+            }
+            case ObjectAccessMonomorphic: {
+                AttributeCache &cache = code->attribute_caches[read_operand(operands)];
+                Object *obj = static_cast<Object *>(tos.heap_object());
+                if (!tos.is_object() or obj->shape != cache.entries[0].shape) {
+                    *instruction = ObjectAccess;
+                    ip = instruction;
+                    break;
+                }
+                cache.hits++;
+                tos = obj->slots[cache.entries[0].slot];
+                break;
+            }
+            case StoreAttribute: {
+                Object *obj = tos.object();
+                if (obj == NULL) {
+                    unwind(entry_depth);
+                    return false;
+                }
+                AttributeCache &cache = code->attribute_caches[read_operand(operands)];
+                heap->grew(cache.store(obj, *--sp));
+                reload();
+                if (cache.is_monomorphic())
+                    *instruction = StoreAttributeMonomorphic;
+                break;
+            }
+            case StoreAttributeMonomorphic: {
+                AttributeCache &cache = code->attribute_caches[read_operand(operands)];
+                Object *obj = static_cast<Object *>(tos.heap_object());
+                if (!tos.is_object() or obj->shape != cache.entries[0].shape) {
+                    *instruction = StoreAttribute;
+                    ip = instruction;
+                    break;
+                }
+                cache.hits++;
+                heap->grew(AttributeCache::store_entry(cache.entries[0], obj, sp[-1]));
+                tos = sp[-2];
+                sp -= 2;
+                break;
+            }
+            case StoreVariableAttribute: {
+                Object *obj = base[read_operand(operands)].object();
+                if (obj == NULL) {
+                    unwind(entry_depth);
+                    return false;
+                }
+                heap->grew(code->attribute_caches[read_operand(operands + sizeof(Operand))].store(obj, tos));
+                reload();
+                break;
+            }
+            case PushVariableAttribute: {
+                Object *obj = base[read_operand(operands)].object();
+                if (obj == NULL) {
+                    unwind(entry_depth);
+                    return false;
+                }
+                spill();
+                tos = code->attribute_caches[read_operand(operands + sizeof(Operand))].load(obj);
+                break;
+            }
+            case AddVariableNumber: {
+                Value left = base[read_operand(operands)];
+                Value right = code->constants[read_operand(operands + sizeof(Operand))];
+                spill();
+                tos = left.is_int() and right.is_int() ? Value::create_int(left.int_value() + right.int_value()) : Value::add(*heap, left, right);
+                break;
+            }
+            case MinusVariableNumber: {
+                Value left = base[read_operand(operands)];
+                Value right = code->constants[read_operand(operands + sizeof(Operand))];
+                spill();
+                tos = left.is_int() and right.is_int() ? Value::create_int(left.int_value() - right.int_value()) : Value::minus(left, right);
+                break;
+            }
+            case DivideVariableNumber: {
+                Value left = base[read_operand(operands)];
+                Value right = code->constants[read_operand(operands + sizeof(Operand))];
+                spill();
+                tos = left.is_number() ? Value(left.number() / right.number()) : Value::div(left, right);
+                break;
+            }
+            case MultiplyVariableNumber: {
+                Value left = base[read_operand(operands)];
+                Value right = code->constants[read_operand(operands + sizeof(Operand))];
+                spill();
+                tos = Value::mul(left, right);
+                break;
+            }
+            case CallFunction: {
+                Function &function = *code->functions[read_operand(operands)];
+                spill();
+                /* the parameters already on the stack become the callee's first slots */
+                if (!push_frame(function, sp - function.num_arguments(), ip)) {
+                    unwind(entry_depth);
+                    return false;
+                }
+                load_frame();
+                break;
+            }
+            case CallMethod: {
+                MethodCache &cache = code->method_caches[read_operand(operands)];
+                size_t num_parameters = read_operand(operands + sizeof(Operand));
+                spill();
+                Value *frame = sp - num_parameters - 1;
+                Object *obj = frame->object();
+                Method *method = obj ? cache.lookup(obj->class_struct) : NULL;
+                if (method == NULL or !check_arguments(*method, num_parameters)) {
+                    unwind(entry_depth);
+                    return false;
+                }
+                /* self is passed in the first slot */
+                *frame = Value(obj);
+                if (!push_frame(*method, frame, ip)) {
+                    unwind(entry_depth);
+                    return false;
+                }
+                load_frame();
+                break;
+            }
+            case TailCallFunction: {
+                Function &function = *code->functions[read_operand(operands)];
+                spill();
+                if (!replace_frame(function, sp - function.num_arguments())) {
+                    unwind(entry_depth);
+                    return false;
+                }
+                load_frame();
+                break;
+            }
+            case TailCallMethod: {
+                MethodCache &cache = code->method_caches[read_operand(operands)];
+                size_t num_parameters = read_operand(operands + sizeof(Operand));
+                spill();
+                Value *arguments = sp - num_parameters - 1;
+                Object *obj = arguments->object();
+                Method *method = obj ? cache.lookup(obj->class_struct) : NULL;
+                if (method == NULL or !check_arguments(*method, num_parameters) or !replace_frame(*method, arguments)) {
+                    unwind(entry_depth);
+                    return false;
+                }
+                load_frame();
+                break;
+            }
+            case CallConstructor: {
+                ClassStruct &class_struct = *code->classes[read_operand(operands)];
+                Method *method = class_struct.constructor();
+                if (method == NULL) {
+                    std::cout << "Error: class " << symbol_name(class_struct.name) << " has no __init__ method\n";
+                    unwind(entry_depth);
+                    return false;
+                }
+                spill();
+                /* shift parameters up to make room for self */
+                Value *frame = sp - method->parameters.size();
+                if (!check_frame(frame)) {
+                    unwind(entry_depth);
+                    return false;
+                }
+                std::copy_backward(frame, sp, sp + 1);
+                sp++;
+                *frame = Value(heap->allocate<Object>(&class_struct));
+                if (!push_frame(*method, frame, ip)) {
+                    unwind(entry_depth);
+                    return false;
+                }
+                load_frame();
+                safepoint();
+                break;
+            }
+            default:
+                std::cout << "Error: unknown opcode " << (int) op << std::endl;
+                unwind(entry_depth);
+                return false;
+        }
+    }
+}
@@ -0,0 +1,339 @@
+#include "ir/ir.hpp"
+#include "runtime/builtins.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace ir;
+
+const OpInfo ir::op_info[static_cast<size_t>(Op::NumOps)] = {
+    {"Const", true, true, false},
+    {"Param", true, true, false},
+    {"Phi", true, true, false},
+    {"Copy", true, true, false},
+    {"Add", true, true, false},
+    {"Minus", true, true, false},
+    {"Divide", true, true, false},
+    {"Multiply", true, true, false},
+    {"Negate", true, true, false},
+    {"LoadAttribute", true, false, false},
+    {"StoreAttribute", false, false, false},
+    {"IndexLoad", true, false, false},
+    {"IndexStore", false, false, false},
+    {"BuildList", true, true, false},
+    {"Slice", true, false, false},
+    {"CallFunction", true, false, false},
+    {"CallMethod", true, false, false},
+    {"CallConstructor", true, false, false},
+    {"CallBuiltin", true, false, false},
+    {"GetIterator", false, false, false},
+    {"IterValue", true, false, false},
+    {"Jump", false, false, true},
+    {"ForIter", false, false, true},
+    {"Return", false, false, true},
+    {"ReturnVoid", false, false, true},
+    {"TailCallFunction", false, false, true},
+    {"TailCallMethod", false, false, true},
+};
+
+const char *ir::type_name(Type type) {
+    static const char *names[] = {"Void", "Int", "Double", "Number", "String", "List", "Array", "Object", "Any"};
+    return names[static_cast<size_t>(type)];
+}
+
+static bool is_numeric(Type type) {
+    return type == Type::Int or type == Type::Double or type == Type::Number;
+}
+
+Type ir::join(Type a, Type b) {
+    if (a == b)
+        return a;
+    if (is_numeric(a) and is_numeric(b))
+        return Type::Number;
+    return Type::Any;
+}
+
+Type ir::constant_type(runtime::Value constant) {
+    if (constant.is_int())
+        return Type::Int;
+    if (constant.is_double())
+        return Type::Double;
+    if (constant.is_string())
+        return Type::String;
+    if (constant.is_void())
+        return Type::Void;
+    return Type::Any;
+}
+
+/* ints overflow into doubles, so only a double operand fixes the result */
+static Type arithmetic_type(Type a, Type b) {
+    if (!is_numeric(a) or !is_numeric(b))
+        return Type::Any;
+    return a == Type::Double or b == Type::Double ? Type::Double : Type::Number;
+}
+
+Type ir::infer_type(const Instruction &instruction) {
+    const std::vector<Instruction *> &operands = instruction.operands;
+    switch (instruction.op) {
+        case Op::Copy:
+            return operands[0]->type;
+        case Op::Phi: {
+            Type type = operands.empty() ? Type::Any : operands[0]->type;
+            for (Instruction *operand: operands)
+                type = join(type, operand->type);
+            return type;
+        }
+        case Op::Add:
+            if (operands[0]->type == Type::String and operands[1]->type == Type::String)
+                return Type::String;
+            return arithmetic_type(operands[0]->type, operands[1]->type);
+        case Op::Minus:
+        case Op::Multiply:
+            return arithmetic_type(operands[0]->type, operands[1]->type);
+        case Op::Divide:
+            return is_numeric(operands[0]->type) and is_numeric(operands[1]->type) ? Type::Double : Type::Any;
+        case Op::Negate:
+            if (operands[0]->type == Type::Double)
+                return Type::Double;
+            return is_numeric(operands[0]->type) ? Type::Number : Type::Any;
+        case Op::BuildList:
+            return Type::List;
+        case Op::Slice:
+            return operands[0]->type == Type::List or operands[0]->type == Type::Array ? operands[0]->type : Type::Any;
+        case Op::CallConstructor:
+            return Type::Object;
+        default:
+            return instruction.type;
+    }
+}
+
+static bool is_derived(Op op) {
+    switch (op) {
+        case Op::Phi:
+        case Op::Copy:
+        case Op::Add:
+        case Op::Minus:
+        case Op::Divide:
+        case Op::Multiply:
+        case Op::Negate:
+        case Op::Slice:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * Types computed from operands start out unknown and only widen, so a
+ * value carried around a loop gets the join of what enters the loop and
+ * what the body makes of it.
+ */
+void ir::infer_types(Graph &graph) {
+    std::vector<bool> known(graph.num_ids(), true);
+    for (auto &block: graph.blocks) {
+        for (Instruction *phi: block->phis)
+            known[phi->id] = false;
+        for (Instruction *instruction: block->instructions)
+            known[instruction->id] = !is_derived(instruction->op);
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto &block: graph.blocks) {
+            for (Instruction *phi: block->phis) {
+                for (Instruction *operand: phi->operands) {
+                    if (!known[operand->id])
+                        continue;
+                    Type type = known[phi->id] ? join(phi->type, operand->type) : operand->type;
+                    if (!known[phi->id] or type != phi->type)
+                        changed = true;
+                    phi->type = type;
+                    known[phi->id] = true;
+                }
+            }
+            for (Instruction *instruction: block->instructions) {
+                if (!is_derived(instruction->op))
+                    continue;
+                bool ready = true;
+                for (Instruction *operand: instruction->operands)
+                    ready = ready and known[operand->id];
+                if (!ready)
+                    continue;
+                Type type = infer_type(*instruction);
+                if (!known[instruction->id] or type != instruction->type)
+                    changed = true;
+                instruction->type = type;
+                known[instruction->id] = true;
+            }
+        }
+    }
+    /* only values depending on themselves are left */
+    for (auto &block: graph.blocks) {
+        for (Instruction *phi: block->phis) {
+            if (!known[phi->id])
+                phi->type = Type::Any;
+        }
+    }
+}
+
+/* arithmetic only cannot fail when its operands are known */
+bool Instruction::is_pure() const {
+    switch (op) {
+        case Op::Add:
+        case Op::Minus:
+        case Op::Divide:
+        case Op::Multiply:
+        case Op::Negate:
+            return type != Type::Any;
+        default:
+            return info(op).pure;
+    }
+}
+
+Block *Graph::create_block() {
+    blocks.emplace_back(new Block(blocks.size()));
+    return blocks.back().get();
+}
+
+Instruction *Graph::create(Block *block, Op op, Type type, std::vector<Instruction *> operands, uint32_t immediate) {
+    pool.emplace_back(new Instruction(op, type, operands, immediate, block, next_id++));
+    Instruction *instruction = pool.back().get();
+    if (!block->instructions.empty() and block->instructions.back()->is_terminator())
+        block->instructions.insert(block->instructions.end() - 1, instruction);
+    else
+        block->instructions.push_back(instruction);
+    return instruction;
+}
+
+Instruction *Graph::create_phi(Block *block, Type type) {
+    pool.emplace_back(new Instruction(Op::Phi, type, {}, 0, block, next_id++));
+    block->phis.push_back(pool.back().get());
+    return pool.back().get();
+}
+
+Instruction *Graph::constant(runtime::Operand constant) {
+    if (constant >= constants.size())
+        constants.resize(constant + 1, NULL);
+    if (constants[constant] and !constants[constant]->dead)
+        return constants[constant];
+    pool.emplace_back(new Instruction(Op::Const, constant_type(code.constants[constant]), {}, constant, entry(), next_id++));
+    Block *block = entry();
+    block->instructions.insert(block->instructions.begin(), pool.back().get());
+    return constants[constant] = pool.back().get();
+}
+
+void Graph::replace_all_uses(Instruction *old_value, Instruction *new_value) {
+    for (auto &block: blocks) {
+        for (Instruction *phi: block->phis)
+            std::replace(phi->operands.begin(), phi->operands.end(), old_value, new_value);
+        for (Instruction *instruction: block->instructions)
+            std::replace(instruction->operands.begin(), instruction->operands.end(), old_value, new_value);
+    }
+}
+
+static Instruction *replacement(const std::vector<Instruction *> &replacements, Instruction *value) {
+    while (value->id < replacements.size() and replacements[value->id])
+        value = replacements[value->id];
+    return value;
+}
+
+void Graph::replace_uses(const std::vector<Instruction *> &replacements) {
+    for (auto &block: blocks) {
+        for (Instruction *phi: block->phis) {
+            for (Instruction *&operand: phi->operands)
+                operand = replacement(replacements, operand);
+        }
+        for (Instruction *instruction: block->instructions) {
+            for (Instruction *&operand: instruction->operands)
+                operand = replacement(replacements, operand);
+        }
+    }
+}
+
+std::vector<unsigned int> Graph::count_uses() {
+    std::vector<unsigned int> uses(next_id, 0);
+    for (auto &block: blocks) {
+        for (Instruction *phi: block->phis) {
+            for (Instruction *operand: phi->operands)
+                uses[operand->id]++;
+        }
+        for (Instruction *instruction: block->instructions) {
+            for (Instruction *operand: instruction->operands)
+                uses[operand->id]++;
+        }
+    }
+    return uses;
+}
+
+void Graph::sweep() {
+    auto is_dead = [](Instruction *instruction) { return instruction->dead; };
+    for (auto &block: blocks) {
+        block->phis.erase(std::remove_if(block->phis.begin(), block->phis.end(), is_dead), block->phis.end());
+        block->instructions.erase(std::remove_if(block->instructions.begin(), block->instructions.end(), is_dead), block->instructions.end());
+    }
+}
+
+static void print_immediate(runtime::Code &code, const Instruction &instruction) {
+    switch (instruction.op) {
+        case Op::Const:
+            std::cout << " " << code.constant_to_string(instruction.immediate);
+            break;
+        case Op::Param:
+            std::cout << " %" << instruction.immediate;
+            break;
+        case Op::LoadAttribute:
+        case Op::StoreAttribute:
+            std::cout << " <" << symbol_name(instruction.immediate) << ">";
+            break;
+        case Op::CallFunction:
+        case Op::TailCallFunction:
+            std::cout << " " << symbol_name(code.functions[instruction.immediate]->name);
+            break;
+        case Op::CallMethod:
+        case Op::TailCallMethod:
+            std::cout << " " << symbol_name(instruction.immediate);
+            break;
+        case Op::CallConstructor:
+            std::cout << " " << symbol_name(code.classes[instruction.immediate]->name);
+            break;
+        case Op::CallBuiltin:
+            std::cout << " " << runtime::builtins[instruction.immediate].name;
+            break;
+        default:
+            break;
+    }
+}
+
+static void print_instruction(runtime::Code &code, const Instruction &instruction) {
+    std::cout << "    ";
+    /* the loop state has no value, but ForIter refers to it */
+    if (instruction.has_result() or instruction.op == Op::GetIterator)
+        std::cout << "v" << instruction.id << " = ";
+    std::cout << info(instruction.op).name;
+    print_immediate(code, instruction);
+    for (Instruction *operand: instruction.operands)
+        std::cout << " v" << operand->id;
+    for (Block *successor: instruction.is_terminator() ? instruction.block->successors : std::vector<Block *>())
+        std::cout << " b" << successor->id;
+    if (instruction.has_result())
+        std::cout << " : " << type_name(instruction.type);
+    if (instruction.hint != NO_SLOT)
+        std::cout << " %" << instruction.hint;
+    std::cout << std::endl;
+}
+
+void Graph::print() {
+    for (auto &block: blocks) {
+        std::cout << "b" << block->id << ":";
+        if (!block->predecessors.empty()) {
+            std::cout << " <-";
+            for (Block *predecessor: block->predecessors)
+                std::cout << " b" << predecessor->id;
+        }
+        std::cout << std::endl;
+        for (Instruction *phi: block->phis)
+            print_instruction(code, *phi);
+        for (Instruction *instruction: block->instructions)
+            print_instruction(code, *instruction);
+    }
+}
@@ -0,0 +1,455 @@
+#include "ir/ir.hpp"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+using namespace ir;
+
+namespace {
+
+/*
+ * Turns the bytecode of one code object into SSA form. The operand stack
+ * is simulated within each block, variables are renamed as in Braun et
+ * al., "Simple and Efficient Construction of Static Single Assignment
+ * Form": a read looks for the last store in the block and otherwise asks
+ * the predecessors, placing a phi where they may disagree. A loop header
+ * gets incomplete phis until its back edge has been filled.
+ */
+class Builder {
+public:
+    Builder(Graph &graph) : graph(graph), code(graph.code) {}
+    bool build();
+
+private:
+    Graph &graph;
+    runtime::Code &code;
+    /* blocks by the offset of their first instruction */
+    std::map<size_t, Block *> starts;
+    std::vector<size_t> ends;
+    std::vector<std::unordered_map<uint32_t, Instruction *>> definitions;
+    std::vector<std::vector<std::pair<uint32_t, Instruction *>>> incomplete_phis;
+    std::vector<bool> sealed;
+    std::vector<bool> filled;
+    /* the loop states left on the operand stack when entering each block */
+    std::vector<std::vector<Instruction *>> entry_stacks;
+    std::vector<bool> entered;
+    std::vector<Instruction *> stack;
+
+    bool find_blocks();
+    bool fill(Block *block);
+    bool enter(Block *block, const std::vector<Instruction *> &entry_stack);
+    bool pop(Instruction *&value);
+    bool pop(size_t count, std::vector<Instruction *> &values);
+    void seal_ready();
+
+    void write_variable(uint32_t slot, Block *block, Instruction *value);
+    Instruction *read_variable(uint32_t slot, Block *block);
+    Instruction *read_variable_recursive(uint32_t slot, Block *block);
+    Instruction *add_phi_operands(uint32_t slot, Instruction *phi);
+    Instruction *remove_trivial_phi(Instruction *phi);
+    void seal(Block *block);
+};
+
+bool is_block_end(runtime::Opcode op) {
+    switch (op) {
+        case runtime::Return:
+        case runtime::ReturnVoid:
+        case runtime::TailCallFunction:
+        case runtime::TailCallMethod:
+        case runtime::Jump:
+        case runtime::ForIter:
+            return true;
+        default:
+            return false;
+    }
+}
+
+}
+
+/* splits the bytecode at jump targets and after jumps, keeping only reachable blocks */
+bool Builder::find_blocks() {
+    std::vector<uint8_t> &bytecodes = code.bytecodes;
+    std::map<size_t, std::vector<size_t>> successors;
+    std::vector<size_t> leaders = {0};
+    for (size_t pos = 0; pos < bytecodes.size(); pos += runtime::instruction_size(static_cast<runtime::Opcode>(bytecodes[pos]))) {
+        runtime::Opcode op = static_cast<runtime::Opcode>(bytecodes[pos]);
+        /* quickened instructions and superinstructions are only made after compiling */
+        if (op >= runtime::AddInt)
+            return false;
+        size_t next = pos + runtime::instruction_size(op);
+        if (op == runtime::Jump or op == runtime::ForIter)
+            leaders.push_back(runtime::read_operand(&bytecodes[pos + 1]));
+        if (is_block_end(op) and next < bytecodes.size())
+            leaders.push_back(next);
+    }
+    std::sort(leaders.begin(), leaders.end());
+    leaders.erase(std::unique(leaders.begin(), leaders.end()), leaders.end());
+    if (leaders.back() >= bytecodes.size())
+        return false;
+
+    /* the successors of each leader, in the order Block::successors lists them */
+    for (size_t index = 0; index < leaders.size(); index++) {
+        size_t end = index + 1 < leaders.size() ? leaders[index + 1] : bytecodes.size();
+        size_t last = leaders[index];
+        for (size_t pos = last; pos < end; pos += runtime::instruction_size(static_cast<runtime::Opcode>(bytecodes[pos])))
+            last = pos;
+        runtime::Opcode op = static_cast<runtime::Opcode>(bytecodes[last]);
+        if (op == runtime::Jump)
+            successors[leaders[index]] = {runtime::read_operand(&bytecodes[last + 1])};
+        else if (op == runtime::ForIter)
+            successors[leaders[index]] = {end, runtime::read_operand(&bytecodes[last + 1])};
+        else if (!is_block_end(op))
+            successors[leaders[index]] = {end};
+    }
+
+    std::vector<size_t> work = {0};
+    std::map<size_t, bool> reachable;
+    while (!work.empty()) {
+        size_t leader = work.back();
+        work.pop_back();
+        if (reachable[leader])
+            continue;
+        reachable[leader] = true;
+        for (size_t successor: successors[leader])
+            work.push_back(successor);
+    }
+    for (size_t index = 0; index < leaders.size(); index++) {
+        if (reachable[leaders[index]]) {
+            starts[leaders[index]] = graph.create_block();
+            ends.push_back(index + 1 < leaders.size() ? leaders[index + 1] : bytecodes.size());
+        }
+    }
+    for (auto &[leader, block]: starts) {
+        for (size_t successor: successors[leader]) {
+            block->successors.push_back(starts[successor]);
+            starts[successor]->predecessors.push_back(block);
+        }
+    }
+    return true;
+}
+
+void Builder::write_variable(uint32_t slot, Block *block, Instruction *value) {
+    definitions[block->id][slot] = value;
+}
+
+Instruction *Builder::read_variable(uint32_t slot, Block *block) {
+    auto definition = definitions[block->id].find(slot);
+    if (definition != definitions[block->id].end())
+        return definition->second;
+    return read_variable_recursive(slot, block);
+}
+
+Instruction *Builder::read_variable_recursive(uint32_t slot, Block *block) {
+    Instruction *value;
+    if (block == graph.entry()) {
+        /* read before any store, only then does the code need a Void constant */
+        value = graph.constant(code.void_constant());
+    } else if (!sealed[block->id]) {
+        value = graph.create_phi(block, Type::Any);
+        value->hint = slot;
+        incomplete_phis[block->id].push_back({slot, value});
+    } else if (block->predecessors.size() == 1) {
+        value = read_variable(slot, block->predecessors[0]);
+    } else {
+        Instruction *phi = graph.create_phi(block, Type::Any);
+        phi->hint = slot;
+        write_variable(slot, block, phi);
+        value = add_phi_operands(slot, phi);
+    }
+    write_variable(slot, block, value);
+    return value;
+}
+
+Instruction *Builder::add_phi_operands(uint32_t slot, Instruction *phi) {
+    for (Block *predecessor: phi->block->predecessors)
+        phi->operands.push_back(read_variable(slot, predecessor));
+    return remove_trivial_phi(phi);
+}
+
+/* a phi merging only one value besides itself is that value */
+Instruction *Builder::remove_trivial_phi(Instruction *phi) {
+    Instruction *same = NULL;
+    for (Instruction *operand: phi->operands) {
+        if (operand == same or operand == phi)
+            continue;
+        if (same)
+            return phi;
+        same = operand;
+    }
+    /* an undefined variable, only reachable through itself */
+    if (same == NULL)
+        same = graph.constant(code.void_constant());
+    std::vector<Instruction *> users;
+    for (auto &block: graph.blocks) {
+        for (Instruction *user: block->phis) {
+            /* incomplete phis get their operands once their block is sealed */
+            if (user != phi and !user->operands.empty() and std::find(user->operands.begin(), user->operands.end(), phi) != user->operands.end())
+                users.push_back(user);
+        }
+    }
+    graph.replace_all_uses(phi, same);
+    for (auto &block_definitions: definitions) {
+        for (auto &definition: block_definitions) {
+            if (definition.second == phi)
+                definition.second = same;
+        }
+    }
+    std::replace(stack.begin(), stack.end(), phi, same);
+    phi->dead = true;
+    graph.sweep();
+    for (Instruction *user: users) {
+        if (!user->dead)
+            remove_trivial_phi(user);
+    }
+    return same;
+}
+
+void Builder::seal(Block *block) {
+    for (auto &[slot, phi]: incomplete_phis[block->id])
+        add_phi_operands(slot, phi);
+    incomplete_phis[block->id].clear();
+    sealed[block->id] = true;
+}
+
+void Builder::seal_ready() {
+    for (auto &block: graph.blocks) {
+        if (sealed[block->id])
+            continue;
+        bool ready = true;
+        for (Block *predecessor: block->predecessors)
+            ready = ready and filled[predecessor->id];
+        if (ready)
+            seal(block.get());
+    }
+}
+
+bool Builder::pop(Instruction *&value) {
+    /* the state of a loop is never an operand */
+    if (stack.empty() or stack.back()->op == Op::GetIterator)
+        return false;
+    value = stack.back();
+    stack.pop_back();
+    return true;
+}
+
+bool Builder::pop(size_t count, std::vector<Instruction *> &values) {
+    values.resize(count);
+    for (size_t index = count; index > 0; index--) {
+        if (!pop(values[index - 1]))
+            return false;
+    }
+    return true;
+}
+
+/* every way into a block has to leave the same loop states behind */
+bool Builder::enter(Block *block, const std::vector<Instruction *> &entry_stack) {
+    for (Instruction *value: entry_stack) {
+        if (value->op != Op::GetIterator)
+            return false;
+    }
+    if (entered[block->id])
+        return entry_stacks[block->id] == entry_stack;
+    entered[block->id] = true;
+    entry_stacks[block->id] = entry_stack;
+    return true;
+}
+
+bool Builder::fill(Block *block) {
+    std::vector<uint8_t> &bytecodes = code.bytecodes;
+    size_t start = 0;
+    for (auto &[leader, candidate]: starts) {
+        if (candidate == block)
+            start = leader;
+    }
+    stack = entry_stacks[block->id];
+    /* the body of a loop starts with the element ForIter pushed */
+    if (block->predecessors.size() == 1 and block->predecessors[0]->terminator()->op == Op::ForIter and block->predecessors[0]->successors[0] == block)
+        stack.push_back(graph.create(block, Op::IterValue, Type::Any, {block->predecessors[0]->terminator()->operands[0]}));
+
+    std::vector<Instruction *> operands;
+    Instruction *a, *b, *c;
+    bool terminated = false;
+    for (size_t pos = start; pos < ends[block->id]; pos += runtime::instruction_size(static_cast<runtime::Opcode>(bytecodes[pos]))) {
+        runtime::Opcode op = static_cast<runtime::Opcode>(bytecodes[pos]);
+        runtime::Operand first = runtime::opcode_info[op].num_operands > 0 ? runtime::read_operand(&bytecodes[pos + 1]) : 0;
+        runtime::Operand second = runtime::opcode_info[op].num_operands > 1 ? runtime::read_operand(&bytecodes[pos + 1 + sizeof(runtime::Operand)]) : 0;
+        switch (op) {
+            case runtime::PushConstant:
+                stack.push_back(graph.constant(first));
+                break;
+            case runtime::PushVariable:
+                stack.push_back(read_variable(first, block));
+                break;
+            case runtime::StoreVariable:
+                if (!pop(a))
+                    return false;
+                a = graph.create(block, Op::Copy, a->type, {a});
+                a->hint = first;
+                write_variable(first, block, a);
+                break;
+            case runtime::Add:
+            case runtime::Minus:
+            case runtime::Divide:
+            case runtime::Multiply: {
+                static const Op ops[] = {Op::Add, Op::Minus, Op::Divide, Op::Multiply};
+                if (!pop(b) or !pop(a))
+                    return false;
+                stack.push_back(graph.create(block, ops[op - runtime::Add], Type::Any, {a, b}));
+                break;
+            }
+            case runtime::Negate:
+                if (!pop(a))
+                    return false;
+                stack.push_back(graph.create(block, Op::Negate, Type::Any, {a}));
+                break;
+            case runtime::ObjectAccess:
+                if (!pop(a))
+                    return false;
+                stack.push_back(graph.create(block, Op::LoadAttribute, Type::Any, {a}, code.attribute_caches[first].name));
+                break;
+            case runtime::StoreAttribute:
+                if (!pop(a) or !pop(b))
+                    return false;
+                graph.create(block, Op::StoreAttribute, Type::Void, {b, a}, code.attribute_caches[first].name);
+                break;
+            case runtime::IndexLoad:
+                if (!pop(b) or !pop(a))
+                    return false;
+                stack.push_back(graph.create(block, Op::IndexLoad, Type::Any, {a, b}));
+                break;
+            case runtime::IndexStore:
+                if (!pop(c) or !pop(b) or !pop(a))
+                    return false;
+                graph.create(block, Op::IndexStore, Type::Void, {a, b, c});
+                break;
+            case runtime::BuildList:
+                if (!pop(first, operands))
+                    return false;
+                stack.push_back(graph.create(block, Op::BuildList, Type::List, operands));
+                break;
+            case runtime::Slice:
+                if (!pop(__builtin_popcount(first) + 1, operands))
+                    return false;
+                stack.push_back(graph.create(block, Op::Slice, Type::Any, operands, first));
+                break;
+            case runtime::CallFunction:
+            case runtime::TailCallFunction:
+                if (!pop(code.functions[first]->num_arguments(), operands))
+                    return false;
+                if (op == runtime::CallFunction)
+                    stack.push_back(graph.create(block, Op::CallFunction, Type::Any, operands, first));
+                else
+                    graph.create(block, Op::TailCallFunction, Type::Void, operands, first);
+                break;
+            case runtime::CallMethod:
+            case runtime::TailCallMethod:
+                /* the receiver is below the arguments */
+                if (!pop(second + 1, operands))
+                    return false;
+                if (op == runtime::CallMethod)
+                    stack.push_back(graph.create(block, Op::CallMethod, Type::Any, operands, code.method_caches[first].name));
+                else
+                    graph.create(block, Op::TailCallMethod, Type::Void, operands, code.method_caches[first].name);
+                break;
+            case runtime::CallConstructor: {
+                runtime::Method *init = code.classes[first]->constructor();
+                if (!pop(init ? init->num_arguments() - 1 : 0, operands))
+                    return false;
+                stack.push_back(graph.create(block, Op::CallConstructor, Type::Object, operands, first));
+                break;
+            }
+            case runtime::CallBuiltin:
+                if (!pop(second, operands))
+                    return false;
+                stack.push_back(graph.create(block, Op::CallBuiltin, Type::Any, operands, first));
+                break;
+            case runtime::Pop:
+                if (!pop(a))
+                    return false;
+                break;
+            case runtime::Return:
+                if (!pop(a))
+                    return false;
+                graph.create(block, Op::Return, Type::Void, {a});
+                break;
+            case runtime::ReturnVoid:
+                graph.create(block, Op::ReturnVoid, Type::Void, {});
+                break;
+            case runtime::GetIterator:
+                if (!pop(a))
+                    return false;
+                a = graph.create(block, Op::GetIterator, Type::Void, {a});
+                /* the sequence and the position */
+                stack.push_back(a);
+                stack.push_back(a);
+                break;
+            case runtime::ForIter:
+                if (stack.size() < 2 or stack.back()->op != Op::GetIterator)
+                    return false;
+                graph.create(block, Op::ForIter, Type::Void, {stack.back()});
+                if (!enter(block->successors[0], stack))
+                    return false;
+                stack.resize(stack.size() - 2);
+                if (!enter(block->successors[1], stack))
+                    return false;
+                terminated = true;
+                break;
+            case runtime::Jump:
+                graph.create(block, Op::Jump, Type::Void, {});
+                if (!enter(block->successors[0], stack))
+                    return false;
+                terminated = true;
+                break;
+            default:
+                return false;
+        }
+        if (is_block_end(op) and op != runtime::Jump and op != runtime::ForIter)
+            terminated = true;
+    }
+    if (!terminated) {
+        graph.create(block, Op::Jump, Type::Void, {});
+        if (!enter(block->successors[0], stack))
+            return false;
+    }
+    filled[block->id] = true;
+    return true;
+}
+
+bool Builder::build() {
+    if (code.bytecodes.empty() or !find_blocks())
+        return false;
+    size_t num_blocks = graph.blocks.size();
+    definitions.resize(num_blocks);
+    incomplete_phis.resize(num_blocks);
+    sealed.resize(num_blocks, false);
+    filled.resize(num_blocks, false);
+    entry_stacks.resize(num_blocks);
+    entered.resize(num_blocks, false);
+    entered[0] = true;
+
+    /* arguments are in the first slots, read_variable_recursive makes other variables read before a store Void */
+    Block *entry = graph.entry();
+    sealed[entry->id] = true;
+    for (int slot = 0; slot < code.num_arguments(); slot++) {
+        Instruction *param = graph.create(entry, Op::Param, Type::Any, {}, slot);
+        param->hint = slot;
+        write_variable(slot, entry, param);
+    }
+    for (auto &block: graph.blocks) {
+        seal_ready();
+        if (!fill(block.get()))
+            return false;
+    }
+    seal_ready();
+    infer_types(graph);
+    return true;
+}
+
+std::unique_ptr<Graph> ir::build(runtime::Code &code) {
+    std::unique_ptr<Graph> graph(new Graph(code));
+    Builder builder(*graph);
+    if (!builder.build())
+        return NULL;
+    return graph;
+}
@@ -0,0 +1,395 @@
+#include "ir/ir.hpp"
+
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+
+using namespace ir;
+
+namespace {
+
+/*
+ * Turns a graph back into stack code. An instruction used once, right
+ * where the stack machine would consume it, is emitted in place of its
+ * use like the compiler would have. Every other value used later is stored
+ * to a frame slot: variables of the original code are preferred, values
+ * that are never live at the same time share a slot, and a phi gets the
+ * slot of its operands where they do not interfere.
+ */
+class Lowering {
+public:
+    Lowering(Graph &graph, bool superinstructions) : graph(graph), code(graph.code), superinstructions(superinstructions) {}
+    void lower();
+
+private:
+    Graph &graph;
+    runtime::Code &code;
+    bool superinstructions;
+    std::vector<unsigned int> uses;
+    std::vector<bool> inlined;
+    std::vector<bool> in_slot;
+    std::vector<uint32_t> slots;
+    std::vector<std::set<unsigned int>> interference;
+    /* offsets of jump operands and the block they jump to */
+    std::vector<std::pair<size_t, Block *>> fixups;
+
+    void find_trees();
+    void assign_slots();
+    void add_interference(unsigned int a, unsigned int b);
+    std::vector<Instruction *> emitted_operands(Instruction *instruction);
+
+    void emit(runtime::Opcode op);
+    void emit(runtime::Opcode op, runtime::Operand operand);
+    void emit(runtime::Opcode op, runtime::Operand first, runtime::Operand second);
+    void emit_value(Instruction *value);
+    void emit_instruction(Instruction *instruction);
+    void emit_root(Instruction *instruction);
+    void emit_phi_copies(Block *from, Block *to);
+    void emit_terminator(Block *block, Block *next);
+};
+
+}
+
+/* ForIter and IterValue work on the loop state, which is already on the stack */
+std::vector<Instruction *> Lowering::emitted_operands(Instruction *instruction) {
+    if (instruction->op == Op::ForIter or instruction->op == Op::IterValue)
+        return {};
+    return instruction->operands;
+}
+
+/*
+ * Walks the operands of each instruction from the last one. An operand
+ * computed by the instructions right before it, and used nowhere else, is
+ * emitted as part of it. Constants and slots are pushed where they are
+ * needed and do not take part. This keeps the order of everything with an
+ * effect as it is in the block.
+ */
+void Lowering::find_trees() {
+    inlined.assign(graph.num_ids(), false);
+    std::vector<int> positions(graph.num_ids(), -1);
+    std::vector<int> tree_starts(graph.num_ids(), 0);
+    for (auto &block: graph.blocks) {
+        int position = 0;
+        for (Instruction *instruction: block->instructions) {
+            if (instruction->op == Op::Const or instruction->op == Op::Param)
+                continue;
+            positions[instruction->id] = position;
+            int expected = position - 1;
+            std::vector<Instruction *> operands = emitted_operands(instruction);
+            for (auto operand = operands.rbegin(); operand != operands.rend(); operand++) {
+                Instruction *value = *operand;
+                if (value->op == Op::Const or value->op == Op::Param or value->op == Op::Phi or value->block != block.get())
+                    continue;
+                if (value->op == Op::IterValue or uses[value->id] != 1 or positions[value->id] != expected)
+                    break;
+                inlined[value->id] = true;
+                expected = tree_starts[value->id] - 1;
+            }
+            tree_starts[instruction->id] = expected + 1;
+            position++;
+        }
+    }
+}
+
+void Lowering::add_interference(unsigned int a, unsigned int b) {
+    if (a == b)
+        return;
+    interference[a].insert(b);
+    interference[b].insert(a);
+}
+
+void Lowering::assign_slots() {
+    size_t num_ids = graph.num_ids();
+    in_slot.assign(num_ids, false);
+    std::vector<Instruction *> order;
+    for (auto &block: graph.blocks) {
+        for (Instruction *phi: block->phis) {
+            in_slot[phi->id] = true;
+            order.push_back(phi);
+        }
+        for (Instruction *instruction: block->instructions) {
+            if (instruction->op == Op::Const or !instruction->has_result() or inlined[instruction->id] or uses[instruction->id] == 0)
+                continue;
+            in_slot[instruction->id] = true;
+            order.push_back(instruction);
+        }
+    }
+
+    /* values live at the end of each block, iterated until loops agree */
+    std::vector<std::set<unsigned int>> live_in(graph.blocks.size()), live_out(graph.blocks.size());
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto block = graph.blocks.rbegin(); block != graph.blocks.rend(); block++) {
+            std::set<unsigned int> live;
+            for (Block *successor: (*block)->successors) {
+                size_t index = std::find(successor->predecessors.begin(), successor->predecessors.end(), block->get()) - successor->predecessors.begin();
+                for (unsigned int id: live_in[successor->id])
+                    live.insert(id);
+                for (Instruction *phi: successor->phis)
+                    live.erase(phi->id);
+                for (Instruction *phi: successor->phis) {
+                    if (in_slot[phi->operands[index]->id])
+                        live.insert(phi->operands[index]->id);
+                }
+            }
+            live_out[(*block)->id] = live;
+            for (auto instruction = (*block)->instructions.rbegin(); instruction != (*block)->instructions.rend(); instruction++) {
+                live.erase((*instruction)->id);
+                for (Instruction *operand: emitted_operands(*instruction)) {
+                    if (in_slot[operand->id])
+                        live.insert(operand->id);
+                }
+            }
+            if (live != live_in[(*block)->id]) {
+                live_in[(*block)->id] = live;
+                changed = true;
+            }
+        }
+    }
+
+    interference.assign(num_ids, {});
+    for (auto &block: graph.blocks) {
+        std::set<unsigned int> live = live_out[block->id];
+        for (auto instruction = block->instructions.rbegin(); instruction != block->instructions.rend(); instruction++) {
+            if (in_slot[(*instruction)->id]) {
+                for (unsigned int id: live)
+                    add_interference((*instruction)->id, id);
+                live.erase((*instruction)->id);
+            }
+            for (Instruction *operand: emitted_operands(*instruction)) {
+                if (in_slot[operand->id])
+                    live.insert(operand->id);
+            }
+        }
+        for (Instruction *phi: block->phis) {
+            for (unsigned int id: live)
+                add_interference(phi->id, id);
+            for (Instruction *other: block->phis)
+                add_interference(phi->id, other->id);
+        }
+    }
+
+    /* the phis each value flows into, their slots save a copy */
+    std::unordered_map<unsigned int, std::vector<Instruction *>> phi_users;
+    for (auto &block: graph.blocks) {
+        for (Instruction *phi: block->phis) {
+            for (Instruction *operand: phi->operands)
+                phi_users[operand->id].push_back(phi);
+        }
+    }
+    slots.assign(num_ids, NO_SLOT);
+    for (Instruction *value: order) {
+        if (value->op == Op::Param)
+            slots[value->id] = value->immediate;
+    }
+    /* values of variables pick first, so temporaries do not take their slots */
+    std::stable_partition(order.begin(), order.end(), [](Instruction *value) { return value->hint != NO_SLOT; });
+    for (Instruction *value: order) {
+        if (slots[value->id] != NO_SLOT)
+            continue;
+        std::set<uint32_t> taken;
+        for (unsigned int id: interference[value->id]) {
+            if (slots[id] != NO_SLOT)
+                taken.insert(slots[id]);
+        }
+        std::vector<uint32_t> candidates = {value->hint};
+        if (value->op == Op::Phi) {
+            for (Instruction *operand: value->operands)
+                candidates.push_back(slots[operand->id]);
+        }
+        for (Instruction *phi: phi_users[value->id])
+            candidates.push_back(slots[phi->id]);
+        for (uint32_t candidate: candidates) {
+            if (candidate != NO_SLOT and !taken.count(candidate)) {
+                slots[value->id] = candidate;
+                break;
+            }
+        }
+        for (uint32_t slot = 0; slots[value->id] == NO_SLOT; slot++) {
+            if (!taken.count(slot))
+                slots[value->id] = slot;
+        }
+    }
+}
+
+void Lowering::emit(runtime::Opcode op) {
+    code.emit(op);
+    if (superinstructions)
+        code.fuse_superinstruction();
+}
+
+void Lowering::emit(runtime::Opcode op, runtime::Operand operand) {
+    code.emit(op, operand);
+    if (superinstructions)
+        code.fuse_superinstruction();
+}
+
+void Lowering::emit(runtime::Opcode op, runtime::Operand first, runtime::Operand second) {
+    code.emit(op, first, second);
+    if (superinstructions)
+        code.fuse_superinstruction();
+}
+
+void Lowering::emit_value(Instruction *value) {
+    if (value->op == Op::Const)
+        emit(runtime::PushConstant, value->immediate);
+    else if (in_slot[value->id])
+        emit(runtime::PushVariable, slots[value->id]);
+    else
+        emit_instruction(value);
+}
+
+void Lowering::emit_instruction(Instruction *instruction) {
+    for (Instruction *operand: emitted_operands(instruction))
+        emit_value(operand);
+    uint32_t immediate = instruction->immediate;
+    runtime::Operand num_operands = instruction->operands.size();
+    switch (instruction->op) {
+        case Op::Add:
+            emit(runtime::Add);
+            break;
+        case Op::Minus:
+            emit(runtime::Minus);
+            break;
+        case Op::Divide:
+            emit(runtime::Divide);
+            break;
+        case Op::Multiply:
+            emit(runtime::Multiply);
+            break;
+        case Op::Negate:
+            emit(runtime::Negate);
+            break;
+        case Op::LoadAttribute:
+            emit(runtime::ObjectAccess, code.attribute_cache(immediate));
+            break;
+        case Op::StoreAttribute:
+            emit(runtime::StoreAttribute, code.attribute_cache(immediate));
+            break;
+        case Op::IndexLoad:
+            emit(runtime::IndexLoad);
+            break;
+        case Op::IndexStore:
+            emit(runtime::IndexStore);
+            break;
+        case Op::BuildList:
+            emit(runtime::BuildList, num_operands);
+            break;
+        case Op::Slice:
+            emit(runtime::Slice, immediate);
+            break;
+        case Op::CallFunction:
+            emit(runtime::CallFunction, immediate);
+            break;
+        case Op::CallMethod:
+            emit(runtime::CallMethod, code.method_cache(immediate), num_operands - 1);
+            break;
+        case Op::CallConstructor:
+            emit(runtime::CallConstructor, immediate);
+            break;
+        case Op::CallBuiltin:
+            emit(runtime::CallBuiltin, immediate, num_operands);
+            break;
+        case Op::GetIterator:
+            emit(runtime::GetIterator);
+            break;
+        case Op::Return:
+            emit(runtime::Return);
+            break;
+        case Op::ReturnVoid:
+            emit(runtime::ReturnVoid);
+            break;
+        case Op::TailCallFunction:
+            emit(runtime::TailCallFunction, immediate);
+            break;
+        case Op::TailCallMethod:
+            emit(runtime::TailCallMethod, code.method_cache(immediate), num_operands - 1);
+            break;
+        /* a copy is its operand, IterValue was pushed by ForIter */
+        default:
+            break;
+    }
+}
+
+void Lowering::emit_root(Instruction *instruction) {
+    emit_instruction(instruction);
+    if (in_slot[instruction->id])
+        emit(runtime::StoreVariable, slots[instruction->id]);
+    else if (instruction->has_result())
+        emit(runtime::Pop);
+}
+
+/* all values are pushed before the first store, so phis may swap their slots */
+void Lowering::emit_phi_copies(Block *from, Block *to) {
+    size_t index = std::find(to->predecessors.begin(), to->predecessors.end(), from) - to->predecessors.begin();
+    std::vector<Instruction *> targets;
+    for (Instruction *phi: to->phis) {
+        Instruction *value = phi->operands[index];
+        if (value->op != Op::Const and slots[value->id] == slots[phi->id])
+            continue;
+        emit_value(value);
+        targets.push_back(phi);
+    }
+    for (auto phi = targets.rbegin(); phi != targets.rend(); phi++)
+        emit(runtime::StoreVariable, slots[(*phi)->id]);
+}
+
+void Lowering::emit_terminator(Block *block, Block *next) {
+    Instruction *terminator = block->terminator();
+    switch (terminator->op) {
+        case Op::Jump:
+            emit_phi_copies(block, block->successors[0]);
+            if (block->successors[0] != next) {
+                fixups.push_back({code.bytecodes.size(), block->successors[0]});
+                emit(runtime::Jump, 0);
+            }
+            break;
+        case Op::ForIter:
+            /* the body follows, only leaving the loop jumps */
+            fixups.push_back({code.bytecodes.size(), block->successors[1]});
+            emit(runtime::ForIter, 0);
+            break;
+        default:
+            emit_instruction(terminator);
+            break;
+    }
+}
+
+void Lowering::lower() {
+    uses = graph.count_uses();
+    find_trees();
+    assign_slots();
+
+    code.bytecodes.clear();
+    code.instructions.clear();
+    code.attribute_caches.clear();
+    code.method_caches.clear();
+    std::vector<size_t> labels(graph.blocks.size());
+    for (size_t index = 0; index < graph.blocks.size(); index++) {
+        Block *block = graph.blocks[index].get();
+        labels[block->id] = code.label();
+        for (Instruction *instruction: block->instructions) {
+            if (instruction->is_terminator() or instruction->op == Op::Const or instruction->op == Op::Param or inlined[instruction->id])
+                continue;
+            emit_root(instruction);
+        }
+        emit_terminator(block, index + 1 < graph.blocks.size() ? graph.blocks[index + 1].get() : NULL);
+    }
+    for (auto &[position, target]: fixups)
+        code.set_operand(position, 0, labels[target->id]);
+
+    size_t needed = code.num_arguments();
+    for (uint32_t slot: slots) {
+        if (slot != NO_SLOT)
+            needed = std::max(needed, static_cast<size_t>(slot) + 1);
+    }
+    size_t variables = code.num_arguments() + code.variables.size();
+    code.temporaries = needed > variables ? needed - variables : 0;
+    code.finish();
+}
+
+void ir::lower(Graph &graph, bool superinstructions) {
+    Lowering lowering(graph, superinstructions);
+    lowering.lower();
+}
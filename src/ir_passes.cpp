@@ -0,0 +1,605 @@
+#include "ir/passes.hpp"
+
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+using namespace ir;
+
+namespace {
+
+/* the class an instance certainly has, NULL if unknown */
+runtime::ClassStruct *known_class(Graph &graph, Instruction *receiver) {
+    while (receiver->op == Op::Copy)
+        receiver = receiver->operands[0];
+    if (receiver->op == Op::CallConstructor)
+        return graph.code.classes[receiver->immediate].get();
+    /* there is no inheritance, self is an instance of the method's class */
+    runtime::Method *method = dynamic_cast<runtime::Method *>(&graph.code);
+    if (method and receiver->op == Op::Param and receiver->immediate == 0)
+        return method->class_struct.get();
+    return NULL;
+}
+
+/* the code a call certainly runs, NULL if it is not known before running */
+runtime::Code *callee(Graph &graph, Instruction *call) {
+    switch (call->op) {
+        case Op::CallFunction:
+        case Op::TailCallFunction:
+            return graph.code.functions[call->immediate].get();
+        case Op::CallMethod:
+        case Op::TailCallMethod: {
+            runtime::ClassStruct *class_struct = known_class(graph, call->operands[0]);
+            return class_struct ? class_struct->lookup_method(call->immediate) : NULL;
+        }
+        default:
+            return NULL;
+    }
+}
+
+/* the immediate of instruction with the tables of from, in those of to */
+uint32_t import_immediate(runtime::Code &to, runtime::Code &from, const Instruction &instruction) {
+    switch (instruction.op) {
+        case Op::Const: {
+            runtime::Value constant = from.constants[instruction.immediate];
+            if (constant.is_string())
+                return to.string_constant(constant.string()->characters());
+            return to.number_constant(constant);
+        }
+        case Op::CallFunction:
+        case Op::TailCallFunction:
+            return to.function_index(from.functions[instruction.immediate]);
+        case Op::CallConstructor:
+            return to.class_index(from.classes[instruction.immediate]);
+        default:
+            return instruction.immediate;
+    }
+}
+
+/* a single block without loops, small enough to copy, that does not call itself */
+bool is_small(Graph &body) {
+    if (body.blocks.size() != 1)
+        return false;
+    size_t size = 0;
+    for (Instruction *instruction: body.entry()->instructions) {
+        if (callee(body, instruction) == &body.code)
+            return false;
+        if (instruction->op != Op::Const and instruction->op != Op::Param and instruction->op != Op::Copy and !instruction->is_terminator())
+            size++;
+    }
+    return size <= INLINE_MAX_SIZE;
+}
+
+/*
+ * Appends a copy of the body of callee to block, with its parameters
+ * replaced by arguments. Returns the value the callee returns, or NULL in
+ * tail position, where block then ends like the callee.
+ */
+Instruction *splice(Graph &graph, Block *block, const std::vector<Instruction *> &arguments, Graph &callee, bool tail) {
+    std::vector<Instruction *> values(callee.num_ids(), NULL);
+    for (Instruction *instruction: callee.entry()->instructions) {
+        std::vector<Instruction *> operands;
+        for (Instruction *operand: instruction->operands)
+            operands.push_back(values[operand->id]);
+        uint32_t immediate = import_immediate(graph.code, callee.code, *instruction);
+        switch (instruction->op) {
+            case Op::Param:
+                values[instruction->id] = arguments[instruction->immediate];
+                break;
+            case Op::Const:
+                values[instruction->id] = graph.constant(immediate);
+                break;
+            case Op::Return:
+                if (!tail)
+                    return operands[0];
+                graph.create(block, Op::Return, Type::Void, operands);
+                return NULL;
+            case Op::ReturnVoid:
+                if (!tail)
+                    return graph.constant(graph.code.void_constant());
+                graph.create(block, Op::ReturnVoid, Type::Void, {});
+                return NULL;
+            case Op::TailCallFunction:
+                if (!tail)
+                    return graph.create(block, Op::CallFunction, Type::Any, operands, immediate);
+                graph.create(block, Op::TailCallFunction, Type::Void, operands, immediate);
+                return NULL;
+            case Op::TailCallMethod:
+                if (!tail)
+                    return graph.create(block, Op::CallMethod, Type::Any, operands, immediate);
+                graph.create(block, Op::TailCallMethod, Type::Void, operands, immediate);
+                return NULL;
+            default:
+                values[instruction->id] = graph.create(block, instruction->op, instruction->type, operands, immediate);
+                break;
+        }
+    }
+    return NULL;
+}
+
+}
+
+/* the callee's graph if the call may be replaced by it */
+Graph *Inliner::inlinable(Graph &graph, Instruction *call) {
+    runtime::Code *code = callee(graph, call);
+    if (code == NULL or code == &graph.code or code->num_arguments() != static_cast<int>(call->operands.size()))
+        return NULL;
+    Graph *body = manager.graph(*code);
+    return body and is_small(*body) ? body : NULL;
+}
+
+void Inliner::run(Graph &graph) {
+    size_t budget = INLINE_MAX_GROWTH;
+    std::unordered_map<Instruction *, Instruction *> results;
+    for (auto &block: graph.blocks) {
+        /* calls in the copied bodies are left alone, so recursion through other callees ends */
+        std::vector<Instruction *> instructions;
+        instructions.swap(block->instructions);
+        for (Instruction *instruction: instructions) {
+            /* a receiver returned by an inlined call may now have a known class */
+            for (Instruction *&operand: instruction->operands) {
+                auto result = results.find(operand);
+                if (result != results.end())
+                    operand = result->second;
+            }
+            Graph *body = inlinable(graph, instruction);
+            size_t size = body ? body->entry()->instructions.size() : 0;
+            if (body == NULL or size > budget) {
+                block->instructions.push_back(instruction);
+                continue;
+            }
+            budget -= size;
+            if (Instruction *result = splice(graph, block.get(), instruction->operands, *body, instruction->is_terminator()))
+                results[instruction] = result;
+            instruction->dead = true;
+        }
+    }
+    std::vector<Instruction *> replacements(graph.num_ids(), NULL);
+    for (auto &result: results)
+        replacements[result.first->id] = result.second;
+    graph.replace_uses(replacements);
+    infer_types(graph);
+}
+
+/* replaces phis merging a single value, and phis using them that become trivial in turn */
+static void remove_trivial_phis(Graph &graph) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto &block: graph.blocks) {
+            for (Instruction *phi: block->phis) {
+                if (phi->dead)
+                    continue;
+                Instruction *same = NULL;
+                bool trivial = true;
+                for (Instruction *operand: phi->operands) {
+                    if (operand == phi or operand == same)
+                        continue;
+                    trivial = trivial and same == NULL;
+                    same = operand;
+                }
+                if (!trivial or same == NULL)
+                    continue;
+                graph.replace_all_uses(phi, same);
+                phi->dead = true;
+                changed = true;
+            }
+        }
+    }
+}
+
+void CopyPropagation::run(Graph &graph) {
+    std::vector<Instruction *> replacements(graph.num_ids(), NULL);
+    for (auto &block: graph.blocks) {
+        for (Instruction *instruction: block->instructions) {
+            if (instruction->op != Op::Copy)
+                continue;
+            Instruction *value = instruction->operands[0];
+            while (replacements[value->id])
+                value = replacements[value->id];
+            if (value->hint == NO_SLOT and value->op != Op::Const)
+                value->hint = instruction->hint;
+            replacements[instruction->id] = value;
+            instruction->dead = true;
+        }
+    }
+    graph.replace_uses(replacements);
+    remove_trivial_phis(graph);
+    graph.sweep();
+}
+
+void DeadCodeElimination::run(Graph &graph) {
+    std::vector<bool> live(graph.num_ids(), false);
+    std::vector<Instruction *> work;
+    for (auto &block: graph.blocks) {
+        for (Instruction *instruction: block->instructions) {
+            if (!instruction->is_pure()) {
+                live[instruction->id] = true;
+                work.push_back(instruction);
+            }
+        }
+    }
+    while (!work.empty()) {
+        Instruction *instruction = work.back();
+        work.pop_back();
+        for (Instruction *operand: instruction->operands) {
+            if (!live[operand->id]) {
+                live[operand->id] = true;
+                work.push_back(operand);
+            }
+        }
+    }
+    for (auto &block: graph.blocks) {
+        for (Instruction *phi: block->phis)
+            phi->dead = !live[phi->id];
+        for (Instruction *instruction: block->instructions)
+            instruction->dead = !live[instruction->id];
+    }
+    graph.sweep();
+}
+
+/* the immediate dominator of every block but the entry, by block id */
+static std::vector<Block *> dominators(Graph &graph) {
+    std::vector<size_t> order(graph.blocks.size());
+    for (size_t index = 0; index < graph.blocks.size(); index++)
+        order[graph.blocks[index]->id] = index;
+    std::vector<Block *> idom(graph.blocks.size(), NULL);
+    Block *entry = graph.entry();
+    idom[entry->id] = entry;
+    /* blocks come after their dominators, so walking up from the later one meets */
+    auto intersect = [&](Block *a, Block *b) {
+        while (a != b) {
+            while (order[a->id] > order[b->id])
+                a = idom[a->id];
+            while (order[b->id] > order[a->id])
+                b = idom[b->id];
+        }
+        return a;
+    };
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto &block: graph.blocks) {
+            if (block.get() == entry)
+                continue;
+            Block *dominator = NULL;
+            for (Block *predecessor: block->predecessors) {
+                if (idom[predecessor->id] == NULL)
+                    continue;
+                dominator = dominator ? intersect(dominator, predecessor) : predecessor;
+            }
+            if (dominator != idom[block->id]) {
+                idom[block->id] = dominator;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+static std::vector<std::vector<Block *>> dominator_tree(Graph &graph) {
+    std::vector<Block *> idom = dominators(graph);
+    std::vector<std::vector<Block *>> children(graph.blocks.size());
+    for (auto &block: graph.blocks) {
+        if (block.get() != graph.entry())
+            children[idom[block->id]->id].push_back(block.get());
+    }
+    return children;
+}
+
+namespace {
+
+using Expression = std::tuple<Op, uint32_t, std::vector<unsigned int>>;
+
+void number_values(Block *block, std::map<Expression, Instruction *> available, const std::vector<std::vector<Block *>> &children, std::vector<Instruction *> &replacements) {
+    for (Instruction *instruction: block->instructions) {
+        switch (instruction->op) {
+            case Op::Add:
+            case Op::Minus:
+            case Op::Divide:
+            case Op::Multiply:
+            case Op::Negate:
+                break;
+            default:
+                continue;
+        }
+        std::vector<unsigned int> operands;
+        for (Instruction *operand: instruction->operands) {
+            while (replacements[operand->id])
+                operand = replacements[operand->id];
+            operands.push_back(operand->id);
+        }
+        Expression expression(instruction->op, instruction->immediate, operands);
+        auto earlier = available.find(expression);
+        if (earlier != available.end()) {
+            replacements[instruction->id] = earlier->second;
+            instruction->dead = true;
+        } else
+            available[expression] = instruction;
+    }
+    for (Block *child: children[block->id])
+        number_values(child, available, children, replacements);
+}
+
+}
+
+void CommonSubexpressionElimination::run(Graph &graph) {
+    std::vector<Instruction *> replacements(graph.num_ids(), NULL);
+    number_values(graph.entry(), {}, dominator_tree(graph), replacements);
+    graph.replace_uses(replacements);
+    graph.sweep();
+}
+
+namespace {
+
+/* attribute name and object */
+using Location = std::pair<uint32_t, unsigned int>;
+
+void forward_loads(Block *block, std::map<Location, Instruction *> available, const std::vector<std::vector<Block *>> &children, std::vector<Instruction *> &replacements) {
+    /* only what certainly ran right before is known, merges start over */
+    if (block->predecessors.size() != 1)
+        available.clear();
+    for (Instruction *instruction: block->instructions) {
+        switch (instruction->op) {
+            case Op::LoadAttribute: {
+                Instruction *object = instruction->operands[0];
+                while (replacements[object->id])
+                    object = replacements[object->id];
+                Location location(instruction->immediate, object->id);
+                auto earlier = available.find(location);
+                if (earlier != available.end()) {
+                    replacements[instruction->id] = earlier->second;
+                    instruction->dead = true;
+                } else
+                    available[location] = instruction;
+                break;
+            }
+            case Op::StoreAttribute: {
+                Instruction *value = instruction->operands[0];
+                Instruction *object = instruction->operands[1];
+                while (replacements[value->id])
+                    value = replacements[value->id];
+                while (replacements[object->id])
+                    object = replacements[object->id];
+                /* any other object may be the same one */
+                auto other = available.lower_bound(Location(instruction->immediate, 0));
+                while (other != available.end() and other->first.first == instruction->immediate)
+                    other = available.erase(other);
+                available[Location(instruction->immediate, object->id)] = value;
+                break;
+            }
+            /* builtins never run code of the script */
+            case Op::CallFunction:
+            case Op::CallMethod:
+            case Op::CallConstructor:
+                available.clear();
+                break;
+            default:
+                break;
+        }
+    }
+    for (Block *child: children[block->id])
+        forward_loads(child, available, children, replacements);
+}
+
+}
+
+void RedundantLoadElimination::run(Graph &graph) {
+    std::vector<Instruction *> replacements(graph.num_ids(), NULL);
+    forward_loads(graph.entry(), {}, dominator_tree(graph), replacements);
+    graph.replace_uses(replacements);
+    graph.sweep();
+}
+
+namespace {
+
+/* values used other than as the object of an attribute access, by id, not counting the uses of ignored */
+std::vector<bool> find_escapes(Graph &graph, Instruction *ignored = NULL) {
+    std::vector<bool> escapes(graph.num_ids(), false);
+    auto visit = [&](Instruction *user) {
+        for (size_t index = 0; index < user->operands.size(); index++) {
+            bool accessed = user->op == Op::LoadAttribute or (user->op == Op::StoreAttribute and index == 1);
+            if (!accessed)
+                escapes[user->operands[index]->id] = true;
+        }
+    };
+    for (auto &block: graph.blocks) {
+        for (Instruction *phi: block->phis)
+            visit(phi);
+        for (Instruction *instruction: block->instructions) {
+            if (instruction != ignored)
+                visit(instruction);
+        }
+    }
+    return escapes;
+}
+
+/*
+ * Renames the attributes of an object that is never allocated into SSA
+ * values, placing phis where blocks merge, like the builder does with
+ * variables. Every access is dominated by the object, so walking back
+ * from one always meets the object before the entry.
+ */
+class AttributeRenamer {
+public:
+    AttributeRenamer(Graph &graph, Instruction *object, Instruction *void_value)
+        : graph(graph), object(object), void_value(void_value), stored(graph.blocks.size()), entry_values(graph.blocks.size()) {}
+    void run(std::vector<Instruction *> &replacements);
+
+private:
+    Graph &graph;
+    Instruction *object;
+    Instruction *void_value;
+    /* last value each block stores to an attribute, by name */
+    std::vector<std::unordered_map<uint32_t, Instruction *>> stored;
+    std::vector<std::unordered_map<uint32_t, Instruction *>> entry_values;
+
+    Instruction *at_entry(Block *block, uint32_t name);
+    Instruction *at_end(Block *block, uint32_t name);
+};
+
+void AttributeRenamer::run(std::vector<Instruction *> &replacements) {
+    for (auto &block: graph.blocks) {
+        for (Instruction *instruction: block->instructions) {
+            if (instruction->op == Op::StoreAttribute and instruction->operands[1] == object)
+                stored[block->id][instruction->immediate] = instruction->operands[0];
+        }
+    }
+    for (auto &block: graph.blocks) {
+        std::unordered_map<uint32_t, Instruction *> current;
+        bool allocated = false;
+        for (Instruction *instruction: block->instructions) {
+            if (instruction == object)
+                allocated = true;
+            else if (instruction->op == Op::StoreAttribute and instruction->operands[1] == object) {
+                current[instruction->immediate] = instruction->operands[0];
+                instruction->dead = true;
+            } else if (instruction->op == Op::LoadAttribute and instruction->operands[0] == object) {
+                auto value = current.find(instruction->immediate);
+                if (value != current.end())
+                    replacements[instruction->id] = value->second;
+                else
+                    replacements[instruction->id] = allocated ? void_value : at_entry(block.get(), instruction->immediate);
+                instruction->dead = true;
+            }
+        }
+    }
+}
+
+Instruction *AttributeRenamer::at_end(Block *block, uint32_t name) {
+    auto value = stored[block->id].find(name);
+    if (value != stored[block->id].end())
+        return value->second;
+    if (block == object->block)
+        return void_value;
+    return at_entry(block, name);
+}
+
+Instruction *AttributeRenamer::at_entry(Block *block, uint32_t name) {
+    auto known = entry_values[block->id].find(name);
+    if (known != entry_values[block->id].end())
+        return known->second;
+    if (block->predecessors.empty())
+        return void_value;
+    if (block->predecessors.size() == 1)
+        return entry_values[block->id][name] = at_end(block->predecessors[0], name);
+    /* registered before asking the predecessors, which may loop back here */
+    Instruction *phi = graph.create_phi(block, Type::Any);
+    entry_values[block->id][name] = phi;
+    for (Block *predecessor: block->predecessors)
+        phi->operands.push_back(at_end(predecessor, name));
+    return phi;
+}
+
+}
+
+/* the constructor's graph if object may be replaced by its attributes */
+Graph *ScalarReplacement::replaceable(Graph &graph, Instruction *object, const std::vector<bool> &escapes) {
+    if (object->op != Op::CallConstructor or escapes[object->id])
+        return NULL;
+    runtime::Method *constructor = graph.code.classes[object->immediate]->constructor();
+    if (constructor == NULL or constructor->num_arguments() != static_cast<int>(object->operands.size()) + 1)
+        return NULL;
+    Graph *body = manager.graph(*constructor);
+    if (body == NULL or !is_small(*body))
+        return NULL;
+    /* the constructor returns self, which becomes the object */
+    Instruction *terminator = body->entry()->terminator();
+    bool returns_self = terminator->op == Op::Return and terminator->operands[0]->op == Op::Param and terminator->operands[0]->immediate == 0;
+    if (!returns_self and terminator->op != Op::ReturnVoid)
+        return NULL;
+    std::vector<bool> body_escapes = find_escapes(*body, terminator);
+    for (Instruction *instruction: body->entry()->instructions) {
+        if (instruction->op == Op::Param and instruction->immediate == 0 and body_escapes[instruction->id])
+            return NULL;
+    }
+    return body;
+}
+
+void ScalarReplacement::run(Graph &graph) {
+    std::vector<bool> escapes = find_escapes(graph);
+    std::vector<Instruction *> objects;
+    for (auto &block: graph.blocks) {
+        std::vector<Instruction *> instructions;
+        instructions.swap(block->instructions);
+        for (Instruction *instruction: instructions) {
+            block->instructions.push_back(instruction);
+            Graph *constructor = replaceable(graph, instruction, escapes);
+            if (constructor == NULL)
+                continue;
+            /* the constructor's accesses of self are renamed with the others */
+            std::vector<Instruction *> arguments(1, instruction);
+            arguments.insert(arguments.end(), instruction->operands.begin(), instruction->operands.end());
+            splice(graph, block.get(), arguments, *constructor, false);
+            objects.push_back(instruction);
+        }
+    }
+    if (objects.empty())
+        return;
+    Instruction *void_value = graph.constant(graph.code.void_constant());
+    std::vector<Instruction *> replacements(graph.num_ids(), NULL);
+    for (Instruction *object: objects) {
+        AttributeRenamer(graph, object, void_value).run(replacements);
+        object->dead = true;
+    }
+    graph.replace_uses(replacements);
+    remove_trivial_phis(graph);
+    graph.sweep();
+    infer_types(graph);
+}
+
+PassManager::PassManager(int level) {
+    if (level >= 1) {
+        add(std::unique_ptr<Pass>(new Inliner(*this)));
+        add(std::unique_ptr<Pass>(new CopyPropagation()));
+        add(std::unique_ptr<Pass>(new ScalarReplacement(*this)));
+    }
+    if (level >= 2) {
+        add(std::unique_ptr<Pass>(new RedundantLoadElimination()));
+        add(std::unique_ptr<Pass>(new CommonSubexpressionElimination()));
+    }
+    if (level >= 1)
+        add(std::unique_ptr<Pass>(new DeadCodeElimination()));
+}
+
+void PassManager::add(std::unique_ptr<Pass> pass) {
+    passes.push_back(std::move(pass));
+}
+
+void PassManager::print(Graph &graph, const char *stage) {
+    if (dump != "all" and dump != stage)
+        return;
+    std::cout << "IR of " << graph.code.describe() << " after " << stage << ":\n";
+    graph.print();
+}
+
+Graph *PassManager::graph(runtime::Code &code) {
+    auto it = graphs.find(&code);
+    return it != graphs.end() ? it->second.get() : NULL;
+}
+
+/* everything is built before lowering, so callees are inlined from generic instructions */
+void PassManager::run(const std::vector<runtime::Code *> &codes, bool superinstructions) {
+    for (runtime::Code *code: codes) {
+        std::unique_ptr<Graph> graph = build(*code);
+        if (graph == NULL)
+            continue;
+        print(*graph, "build");
+        graphs[code] = std::move(graph);
+    }
+    for (runtime::Code *code: codes) {
+        Graph *graph = this->graph(*code);
+        if (graph == NULL)
+            continue;
+        for (auto &pass: passes) {
+            pass->run(*graph);
+            print(*graph, pass->name());
+        }
+    }
+    for (runtime::Code *code: codes) {
+        if (Graph *graph = this->graph(*code))
+            lower(*graph, superinstructions);
+    }
+    graphs.clear();
+}
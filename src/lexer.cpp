@@ -184,6 +184,8 @@ void Lexer::submit_location_record(Range range, Token::Type type) {
     range.end.column = column;
     range.end.row = lineno;
     tokens->tokens.push_back(Token(type, range, code_string));
+    if (type == Token::Word)
+        tokens->tokens.back().symbol = SymbolTable::global().intern(tokens->tokens.back().view());
 }
 
 char Lexer::get(size_t idx) {
@@ -199,6 +201,10 @@ std::string Token::literal() const {
     return code_string->substr(location.startidx, location.endidx - location.startidx + 1);
 }
 
+std::string_view Token::view() const {
+    return std::string_view(*code_string).substr(location.startidx, location.endidx - location.startidx + 1);
+}
+
 void Token::print() {
     std::cout << "<" << type_strings[type];
     switch(type) {
@@ -78,7 +78,9 @@ std::shared_ptr<ast::File> Parser::parse_file() {
             file->classes.push_back(class_definition);
         }else if (parse_newline()) {
         } else {
-            file->code->statements.push_back(parse_statement());
+            std::shared_ptr<ast::Statement> statement = parse_statement();
+            if (statement)
+                file->code->statements.push_back(statement);
             if (position < tokens->tokens.size())
                 parse_newline();
         }
@@ -94,8 +96,12 @@ std::shared_ptr<ast::Block> Parser::parse_block() {
         seperated = false;
         if (!parse_indentation())
             break;
-        block.push_back(parse_statement());
-        seperated = parse_newline();
+        /* a statement that failed to parse is left out */
+        std::shared_ptr<ast::Statement> statement = parse_statement();
+        if (statement)
+            block.push_back(statement);
+        /* a nested block already consumed the newlines after it */
+        seperated = parse_newline() or std::dynamic_pointer_cast<ast::For>(statement);
         while(parse_newline()) ;
     }
     end_token_range(range);
@@ -103,18 +109,41 @@ std::shared_ptr<ast::Block> Parser::parse_block() {
 }
 
 std::shared_ptr<ast::Statement> Parser::parse_statement() {
-    /* Statement        = IdentifierAcess = Expression | return Expression */
+    /* Statement        = IdentifierAcess = Expression | return Expression | for IdentifierAccess in Expression: Block */
     TokenRange range = start_token_range();
     if (parse_string(std::string("return"))) {
         std::shared_ptr<ast::Expression> expr = parse_expression();
+        if (expr == NULL)
+            return NULL;
         end_token_range(range);
         return ast::Return::create(expr, range, NULL);
     }
-    /* TODO: If, For, While-statements*/
+    if (parse_string(std::string("for"))) {
+        std::shared_ptr<ast::Access> target = parse_identifier_access();
+        if (target == NULL)
+            return NULL;
+        if (at_line_end() or !parse_string(std::string("in"))) {
+            std::cout << "Panic: Parser error" << std::endl;
+            return NULL;
+        }
+        std::shared_ptr<ast::Expression> sequence = parse_expression();
+        if (sequence == NULL)
+            return NULL;
+        parse_char_or_panic(':');
+        parse_newline_or_panic();
+        increase_indentation();
+        std::shared_ptr<ast::Block> block = parse_block();
+        decrease_indentation();
+        end_token_range(range);
+        return ast::For::create(target, sequence, block, range, NULL);
+    }
+    /* TODO: If, While-statements*/
     std::shared_ptr<ast::Expression> expr = Parser::parse_expression();
     if (std::shared_ptr<ast::Access> identifier = std::dynamic_pointer_cast<ast::Access>(expr)) {
         if (parse_char('=')) {
             std::shared_ptr<ast::Expression> left = parse_expression();
+            if (left == NULL)
+                return NULL;
             end_token_range(range);
             return ast::Assign::create(identifier, left, NULL, range);
         }
@@ -126,13 +155,19 @@ std::shared_ptr<ast::Expression> Parser::parse_expression() {
     /* Expression = Factor | Factor + Expression | Factor - Expression */
     TokenRange range = start_token_range();
     std::shared_ptr<ast::Expression> factor = parse_factor();
+    if (factor == NULL)
+        return NULL;
     if(parse_char('+')) {
         std::shared_ptr<ast::Expression> right = parse_expression();
+        if (right == NULL)
+            return NULL;
         end_token_range(range);
         std::shared_ptr<ast::Expression> binary = ast::BinaryOp::create(factor, NULL, ast::BinaryOp::Add, range, NULL);
         return std::dynamic_pointer_cast<ast::Expression>(expand_leftmost(right, binary));
     } else if(parse_char('-')) {
         std::shared_ptr<ast::Expression> right = parse_expression();
+        if (right == NULL)
+            return NULL;
         end_token_range(range);
         std::shared_ptr<ast::Expression> binary = ast::BinaryOp::create(factor, NULL, ast::BinaryOp::Min, range, NULL);
         return std::dynamic_pointer_cast<ast::Expression>(expand_leftmost(right, binary));
@@ -144,13 +179,19 @@ std::shared_ptr<ast::Expression> Parser::parse_factor() {
     /* Factor     = UnaryOp | UnaryOp * Factor | UnaryOp / Factor */
     TokenRange range = start_token_range();
     std::shared_ptr<ast::Expression> unaryop = parse_unaryop();
+    if (unaryop == NULL)
+        return NULL;
     if(parse_char('*')) {
         std::shared_ptr<ast::Expression> right = parse_factor();
+        if (right == NULL)
+            return NULL;
         end_token_range(range);
         std::shared_ptr<ast::Expression> binary = ast::BinaryOp::create(unaryop, NULL, ast::BinaryOp::Mul, range, NULL);
         return std::dynamic_pointer_cast<ast::Expression>(expand_leftmost(right, binary));
     } else if(parse_char('/')) {
         std::shared_ptr<ast::Expression> right = parse_factor();
+        if (right == NULL)
+            return NULL;
         end_token_range(range);
         std::shared_ptr<ast::Expression> binary = ast::BinaryOp::create(unaryop, NULL, ast::BinaryOp::Div, range, NULL);
         return std::dynamic_pointer_cast<ast::Expression>(expand_leftmost(right, binary));
@@ -163,6 +204,8 @@ std::shared_ptr<ast::Expression> Parser::parse_unaryop() {
     TokenRange range = start_token_range();
     if(parse_char('-')) {
         std::shared_ptr<ast::Expression> value = parse_value();
+        if (value == NULL)
+            return NULL;
         end_token_range(range);
         return ast::UnaryOp::create(value, range, NULL);
     }
@@ -170,7 +213,7 @@ std::shared_ptr<ast::Expression> Parser::parse_unaryop() {
 }
 
 std::shared_ptr<ast::Expression> Parser::parse_value() {
-    /* Value      = Number | String | Access | (Expression) */
+    /* Value      = Number | String | Access | (Expression) | [Expressions] */
     TokenRange range = start_token_range();
     if(next().type == Token::Number) {
         Token &token = parse_token();
@@ -184,6 +227,28 @@ std::shared_ptr<ast::Expression> Parser::parse_value() {
         std::shared_ptr<ast::Expression> expr = parse_expression();
         parse_char_or_panic(')');
         return expr;
+    } else if(parse_char('[')) {
+        std::vector<std::shared_ptr<ast::Expression>> elements;
+        while (!at_line_end()) {
+            if (parse_char(']')) {
+                end_token_range(range);
+                if (!at_line_end() and parse_char('[')) {
+                    if (parse_subscript() != NULL)
+                        std::cout << "Error: Parser cannot index a list literal" << std::endl;
+                    return NULL;
+                }
+                return ast::List::create(elements, range, NULL);
+            }
+            std::shared_ptr<ast::Expression> element = parse_expression();
+            if (element == NULL)
+                return NULL;
+            elements.push_back(element);
+            /* the last element may be followed by a comma too */
+            if (!at_line_end() and next().view() != "]")
+                parse_char_or_panic(',');
+        }
+        std::cout << "Error: Parser expects ] to close the list" << std::endl;
+        return NULL;
     }
     return parse_identifier_access();
 }
@@ -196,15 +261,18 @@ std::shared_ptr<ast::Access> Parser::parse_identifier_access() {
 }
 
 std::shared_ptr<ast::Access> Parser::parse_access(std::shared_ptr<ast::Access> chain) {
-    /* Access     = None | .IdentifierAccess | [Expression]Access | (Parameters)Access */
+    /* Access     = None | .IdentifierAccess | [Expression]Access | [Slice]Access | (Parameters)Access */
     TokenRange range = start_token_range(chain);
     if(parse_char('.')) {
         std::shared_ptr<ast::Access> access = parse_identifier_access();
+        if (access == NULL)
+            return NULL;
         end_token_range(range);
         return ast::ClassAccess::create(chain, access, range, NULL);
     } else if(parse_char('[')) {
-        std::shared_ptr<ast::Expression> index = parse_expression();
-        parse_char_or_panic(']');
+        std::shared_ptr<ast::Expression> index = parse_subscript();
+        if (index == NULL)
+            return NULL;
         end_token_range(range);
         std::shared_ptr<ast::Access> index_access = ast::IndexAccess::create(chain, index, range, NULL);
         return parse_access(index_access);
@@ -216,7 +284,10 @@ std::shared_ptr<ast::Access> Parser::parse_access(std::shared_ptr<ast::Access> c
                 parse_char_or_panic(',');
             else
                 first = false;
-            parameters.push_back(parse_expression());
+            std::shared_ptr<ast::Expression> parameter = parse_expression();
+            if (parameter == NULL)
+                return NULL;
+            parameters.push_back(parameter);
         }
         end_token_range(range);
         if (std::shared_ptr<ast::Identifier> identifier = std::dynamic_pointer_cast<ast::Identifier>(chain)) {
@@ -230,6 +301,37 @@ std::shared_ptr<ast::Access> Parser::parse_access(std::shared_ptr<ast::Access> c
     return chain;
 }
 
+std::shared_ptr<ast::Expression> Parser::parse_subscript() {
+    /* Subscript  = Expression] | [Expression]:[Expression]] */
+    TokenRange range = start_token_range();
+    std::shared_ptr<ast::Expression> index = NULL;
+    if (!at_line_end() and next().view() != ":" and next().view() != "]") {
+        index = parse_expression();
+        if (index == NULL)
+            return NULL;
+    }
+    if (!at_line_end() and parse_char(':')) {
+        std::shared_ptr<ast::Expression> stop = NULL;
+        if (!at_line_end() and next().view() != "]") {
+            stop = parse_expression();
+            if (stop == NULL)
+                return NULL;
+        }
+        end_token_range(range);
+        index = ast::Slice::create(index, stop, range, NULL);
+    }
+    if (at_line_end()) {
+        std::cout << "Error: Parser expects ] to close the subscript" << std::endl;
+        return NULL;
+    }
+    if (index == NULL) {
+        std::cout << "Error: Parser expects an index before ]" << std::endl;
+        return NULL;
+    }
+    parse_char_or_panic(']');
+    return index;
+}
+
 std::shared_ptr<ast::Identifier> Parser::parse_identifier() {
     TokenRange range = start_token_range();
     Token &token = parse_token();
@@ -238,7 +340,7 @@ std::shared_ptr<ast::Identifier> Parser::parse_identifier() {
 }
 
 bool Parser::parse_char(char c) {
-    if(next().type == Token::Word && next().literal() == std::string{c}) {
+    if(next().type == Token::Word && next().view() == std::string_view(&c, 1)) {
         increase();
         return true;
     }
@@ -246,7 +348,7 @@ bool Parser::parse_char(char c) {
 }
 
 bool Parser::parse_string(const std::string &s) {
-    if(next().type == Token::Word && next().literal() == s) {
+    if(next().type == Token::Word && next().view() == s) {
         increase();
         return true;
     }
@@ -259,6 +361,10 @@ Token & Parser::parse_token() {
     return token;
 }
 
+bool Parser::at_line_end() {
+    return position >= tokens->tokens.size() or tokens->tokens[position].type == Token::Newline;
+}
+
 Token &Parser::next() {
     return tokens->tokens[position];
 }
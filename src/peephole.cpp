@@ -0,0 +1,174 @@
+#include "runtime/peephole.hpp"
+
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace runtime;
+
+namespace {
+
+bool same_variable(Code &, const PeepholeInstruction *matched) {
+    return matched[0].operands[0] == matched[1].operands[0];
+}
+
+bool void_constant(Code &code, const PeepholeInstruction *matched) {
+    return code.constants[matched[0].operands[0]].is_void();
+}
+
+bool jumps_to_next(Code &, const PeepholeInstruction *matched) {
+    return matched[0].operands[0] == matched[0].position + instruction_size(matched[0].op);
+}
+
+}
+
+const PeepholeRule runtime::peephole_rules[] = {
+    /* a value stored to a variable and used right away stays on the stack */
+    {"store-reload", {StoreVariable, PushVariable}, same_variable, {{StoreVariableKeep, 0}}},
+    /* the frame is gone after returning */
+    {"store-return", {StoreVariableKeep, Return}, NULL, {{Return, NO_OPERANDS}}},
+    {"store-pop", {StoreVariableKeep, Pop}, NULL, {{StoreVariable, 0}}},
+    {"self-assign", {PushVariable, StoreVariable}, same_variable, {}},
+    {"push-pop", {PushVariable, Pop}, NULL, {}},
+    {"constant-pop", {PushConstant, Pop}, NULL, {}},
+    {"return-void", {PushConstant, Return}, void_constant, {{ReturnVoid, NO_OPERANDS}}},
+    {"jump-next", {Jump}, jumps_to_next, {}},
+};
+
+const size_t runtime::num_peephole_rules = sizeof(peephole_rules) / sizeof(peephole_rules[0]);
+
+namespace {
+
+std::vector<PeepholeInstruction> decode(Code &code) {
+    std::vector<PeepholeInstruction> decoded;
+    for (size_t pos = 0; pos < code.bytecodes.size(); pos += instruction_size(static_cast<Opcode>(code.bytecodes[pos]))) {
+        PeepholeInstruction instruction{pos, static_cast<Opcode>(code.bytecodes[pos]), {0, 0}};
+        for (unsigned int index = 0; index < opcode_info[instruction.op].num_operands; index++)
+            instruction.operands[index] = read_operand(&code.bytecodes[pos + 1 + index * sizeof(Operand)]);
+        decoded.push_back(instruction);
+    }
+    return decoded;
+}
+
+int stack_effect(Code &code, Opcode op, const Operand *operands) {
+    uint8_t bytes[1 + 2 * sizeof(Operand)] = {op};
+    std::memcpy(bytes + 1, operands, opcode_info[op].num_operands * sizeof(Operand));
+    return code.stack_effect(bytes);
+}
+
+/* whether the replacement of rule may stand in for the matched instructions */
+bool verify(Code &code, const PeepholeRule &rule, const PeepholeInstruction *matched) {
+    int before = 0;
+    for (size_t index = 0; index < rule.pattern.size(); index++)
+        before += stack_effect(code, matched[index].op, matched[index].operands);
+    static const Operand none[2] = {0, 0};
+    int after = 0;
+    for (const PeepholeEmit &emit: rule.replacement) {
+        unsigned int available = emit.operands == NO_OPERANDS ? 0 : opcode_info[matched[emit.operands].op].num_operands;
+        if (opcode_info[emit.op].num_operands > available) {
+            std::cout << "Error: peephole rule " << rule.name << " has no operands for " << opcode_info[emit.op].name << "\n";
+            return false;
+        }
+        after += stack_effect(code, emit.op, emit.operands == NO_OPERANDS ? none : matched[emit.operands].operands);
+    }
+    if (before != after) {
+        std::cout << "Error: peephole rule " << rule.name << " changes the stack effect from " << before << " to " << after << "\n";
+        return false;
+    }
+    return true;
+}
+
+const PeepholeRule *match(Code &code, const std::vector<PeepholeInstruction> &decoded, size_t start, const std::unordered_set<size_t> &targets) {
+    for (size_t index = 0; index < num_peephole_rules; index++) {
+        const PeepholeRule &rule = peephole_rules[index];
+        if (start + rule.pattern.size() > decoded.size())
+            continue;
+        bool matches = true;
+        for (size_t offset = 0; offset < rule.pattern.size() and matches; offset++) {
+            const PeepholeInstruction &instruction = decoded[start + offset];
+            matches = instruction.op == rule.pattern[offset] and (offset == 0 or !targets.count(instruction.position));
+        }
+        const PeepholeInstruction *matched = &decoded[start];
+        if (matches and (rule.condition == NULL or rule.condition(code, matched)) and verify(code, rule, matched))
+            return &rule;
+    }
+    return NULL;
+}
+
+class Rewriter {
+public:
+    Rewriter(Code &code, bool superinstructions) : code(code), superinstructions(superinstructions) {}
+    size_t rewrite();
+
+private:
+    Code &code;
+    bool superinstructions;
+    /* jumps by their new position, with the old position of their target */
+    std::vector<std::pair<size_t, size_t>> fixups;
+
+    void emit(Opcode op, const Operand *operands);
+};
+
+void Rewriter::emit(Opcode op, const Operand *operands) {
+    switch (opcode_info[op].num_operands) {
+        case 0:
+            code.emit(op);
+            break;
+        case 1:
+            code.emit(op, operands[0]);
+            break;
+        default:
+            code.emit(op, operands[0], operands[1]);
+            break;
+    }
+    if (op == Jump or op == ForIter)
+        fixups.emplace_back(code.instructions.back(), operands[0]);
+    else if (superinstructions)
+        code.fuse_superinstruction();
+}
+
+/* one pass over the bytecode, returns the number of rewrites */
+size_t Rewriter::rewrite() {
+    std::vector<PeepholeInstruction> decoded = decode(code);
+    std::unordered_set<size_t> targets;
+    for (const PeepholeInstruction &instruction: decoded) {
+        if (instruction.op == Jump or instruction.op == ForIter)
+            targets.insert(instruction.operands[0]);
+    }
+    code.bytecodes.clear();
+    code.instructions.clear();
+    fixups.clear();
+    std::unordered_map<size_t, size_t> moved;
+    size_t rewrites = 0;
+    for (size_t index = 0; index < decoded.size();) {
+        const PeepholeInstruction &instruction = decoded[index];
+        if (index == 0 or targets.count(instruction.position))
+            moved[instruction.position] = code.label();
+        const PeepholeRule *rule = match(code, decoded, index, targets);
+        if (rule == NULL) {
+            emit(instruction.op, instruction.operands);
+            index++;
+            continue;
+        }
+        static const Operand none[2] = {0, 0};
+        for (const PeepholeEmit &replacement: rule->replacement)
+            emit(replacement.op, replacement.operands == NO_OPERANDS ? none : decoded[index + replacement.operands].operands);
+        index += rule->pattern.size();
+        rewrites++;
+    }
+    for (auto &[position, target]: fixups)
+        code.set_operand(position, 0, moved[target]);
+    return rewrites;
+}
+
+}
+
+size_t runtime::optimize_peephole(Code &code, bool superinstructions) {
+    Rewriter rewriter(code, superinstructions);
+    size_t total = 0;
+    while (size_t rewrites = rewriter.rewrite())
+        total += rewrites;
+    /* the stack depth may have changed */
+    code.finish();
+    return total;
+}
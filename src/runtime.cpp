@@ -1,191 +1,390 @@
+#include "runtime/builtins.hpp"
 #include "runtime/bytecode.hpp"
 #include "runtime/code.hpp"
 #include "runtime/environment.hpp"
+#include "runtime/heap.hpp"
+
+#include <algorithm>
+#include <sstream>
 
 using namespace runtime;
 
-void BinaryOp::execute(Environment &env) {
-    Value left = env.pop(); 
-    Value right = env.pop(); 
-    env.push(perform_op(left, right));
+const OpcodeInfo runtime::opcode_info[NumOpcodes] = {
+    {"Add", 0, -1},
+    {"Minus", 0, -1},
+    {"Divide", 0, -1},
+    {"Multiply", 0, -1},
+    {"PushConstant", 1, 1},
+    {"PushVariable", 1, 1},
+    {"StoreVariable", 1, -1},
+    {"ObjectAccess", 1, 0},
+    {"StoreAttribute", 1, -2},
+    {"CallFunction", 1, 0},
+    {"CallMethod", 2, 0},
+    {"CallConstructor", 1, 0},
+    {"Negate", 0, 0},
+    {"Return", 0, -1},
+    {"ReturnVoid", 0, 0},
+    {"TailCallFunction", 1, 0},
+    {"TailCallMethod", 2, 0},
+    {"Pop", 0, -1},
+    {"IndexLoad", 0, -1},
+    {"IndexStore", 0, -3},
+    {"CallBuiltin", 2, 0},
+    {"BuildList", 1, 0},
+    {"Slice", 1, 0},
+    {"GetIterator", 0, 1},
+    {"ForIter", 1, 1},
+    {"Jump", 1, 0},
+    {"AddInt", 0, -1},
+    {"AddNumber", 0, -1},
+    {"AddString", 0, -1},
+    {"MinusInt", 0, -1},
+    {"MinusNumber", 0, -1},
+    {"DivideNumber", 0, -1},
+    {"MultiplyInt", 0, -1},
+    {"MultiplyNumber", 0, -1},
+    {"ObjectAccessMonomorphic", 1, 0},
+    {"StoreAttributeMonomorphic", 1, -2},
+    {"StoreVariableAttribute", 2, -1},
+    {"PushVariableAttribute", 2, 1},
+    {"AddVariableNumber", 2, 1},
+    {"MinusVariableNumber", 2, 1},
+    {"DivideVariableNumber", 2, 1},
+    {"MultiplyVariableNumber", 2, 1},
+    {"StoreVariableKeep", 1, 0},
+};
+
+void Code::print() {
+    std::cout << "(" << frame_size << " locals, " << max_stack << " stack slots)\n";
+    for (size_t pos = 0; pos < bytecodes.size(); pos += instruction_size(static_cast<Opcode>(bytecodes[pos]))) {
+        std::cout << pos << "\t";
+        print_instruction(&bytecodes[pos]);
+    }
 }
 
-void PushValue::execute(Environment &env) {
-    env.push(value);
+void Code::print_instruction(const uint8_t *ip) {
+    Opcode op = static_cast<Opcode>(*ip);
+    std::cout << opcode_info[op].name;
+    const uint8_t *operands = ip + 1;
+    switch (op) {
+        case PushConstant:
+            std::cout << " " << constant_to_string(read_operand(operands));
+            break;
+        case PushVariable:
+        case StoreVariable:
+        case StoreVariableKeep:
+            std::cout << " %" << read_operand(operands);
+            break;
+        case StoreVariableAttribute:
+        case PushVariableAttribute:
+            std::cout << " %" << read_operand(operands) << " <" << symbol_name(attribute_caches[read_operand(operands + sizeof(Operand))].name) << ">";
+            break;
+        case AddVariableNumber:
+        case MinusVariableNumber:
+        case DivideVariableNumber:
+        case MultiplyVariableNumber:
+            std::cout << " %" << read_operand(operands) << " " << constant_to_string(read_operand(operands + sizeof(Operand)));
+            break;
+        case ObjectAccess:
+        case StoreAttribute:
+        case ObjectAccessMonomorphic:
+        case StoreAttributeMonomorphic:
+            std::cout << " <" << symbol_name(attribute_caches[read_operand(operands)].name) << ">";
+            break;
+        case CallFunction:
+        case TailCallFunction:
+            std::cout << " " << symbol_name(functions[read_operand(operands)]->name);
+            break;
+        case CallMethod:
+        case TailCallMethod:
+            std::cout << " " << symbol_name(method_caches[read_operand(operands)].name) << " (" << read_operand(operands + sizeof(Operand)) << " parameters)";
+            break;
+        case BuildList:
+            std::cout << " " << read_operand(operands);
+            break;
+        case Slice:
+            std::cout << (read_operand(operands) & 1 ? " start" : "") << (read_operand(operands) & 2 ? " stop" : "");
+            break;
+        case ForIter:
+        case Jump:
+            std::cout << " -> " << read_operand(operands);
+            break;
+        case CallBuiltin:
+            std::cout << " " << builtins[read_operand(operands)].name << " (" << read_operand(operands + sizeof(Operand)) << " parameters)";
+            break;
+        case CallConstructor:
+            std::cout << " " << symbol_name(classes[read_operand(operands)]->name);
+            break;
+        default:
+            break;
+    }
+    std::cout << std::endl;
 }
 
-Value Code::run() {
-    Environment env;
-    for(long unsigned int i = 0;i < variables.size(); i++)
-        env.stack.push_back(Value::create_void());
-    for(auto bytecode = bytecodes.rbegin(); bytecode != bytecodes.rend(); bytecode++)
-        bytecode->get()->execute(env);
-    if (!env.is_empty())
-        return env.pop();
-    return Value::create_void();
+void Code::emit(Opcode op) {
+    instructions.push_back(bytecodes.size());
+    bytecodes.push_back(op);
 }
 
-bool Environment::is_empty() {
-    return stack.empty();
+Opcode Code::opcode_back(size_t distance) {
+    if (distance >= instructions.size() - label_instruction)
+        return NumOpcodes;
+    return static_cast<Opcode>(bytecodes[instructions[instructions.size() - 1 - distance]]);
 }
 
-void Environment::push(Value v) {
-    stack.push_back(v);
+Operand Code::operand_back(size_t distance, size_t index) {
+    return read_operand(&bytecodes[instructions[instructions.size() - 1 - distance] + 1 + index * sizeof(Operand)]);
 }
 
-Value Environment::pop() {
-    Value head = stack.back();
-    stack.pop_back();
-    return head;
+void Code::set_operand(size_t position, size_t index, Operand operand) {
+    std::memcpy(&bytecodes[position + 1 + index * sizeof(Operand)], &operand, sizeof(Operand));
 }
 
-void Code::print() {
-    for(auto bytecode = bytecodes.rbegin(); bytecode != bytecodes.rend(); bytecode++)
-        bytecode->get()->print();
+void Code::drop_back(size_t count) {
+    bytecodes.resize(instructions[instructions.size() - count]);
+    instructions.resize(instructions.size() - count);
 }
 
-void Function::print() {
-    std::cout << "Bytecodes for Function " << name << ":\n";
-    Code::print();
+size_t Code::label() {
+    label_instruction = instructions.size();
+    return bytecodes.size();
 }
 
-bool Method::has_return_value(const std::unique_ptr<Environment> &env) {
-    auto buffer_size = parameters.size() + variables.size() + 1; // + 1 for self
-    return env->stack.size() > buffer_size;
+/*
+ * Replaces the instructions just emitted with a superinstruction when they
+ * end in one of the fused sequences. Only the tail is looked at, so a
+ * sequence is fused as soon as its last instruction is emitted. A jump
+ * target is never fused into the instructions before it.
+ */
+void Code::fuse_superinstruction() {
+    Opcode last = opcode_back(0);
+    switch (last) {
+        case StoreAttribute:
+            if (opcode_back(1) == PushVariable) {
+                Operand offset = operand_back(1, 0);
+                Operand cache = operand_back(0, 0);
+                drop_back(2);
+                emit(StoreVariableAttribute, offset, cache);
+            }
+            break;
+        case ObjectAccess:
+            if (opcode_back(1) == PushVariable) {
+                Operand offset = operand_back(1, 0);
+                Operand cache = operand_back(0, 0);
+                drop_back(2);
+                emit(PushVariableAttribute, offset, cache);
+            }
+            break;
+        case Add:
+        case Minus:
+        case Divide:
+        case Multiply:
+            if (opcode_back(1) == PushConstant and constants[operand_back(1, 0)].is_number() and opcode_back(2) == PushVariable) {
+                static const Opcode fused[] = {AddVariableNumber, MinusVariableNumber, DivideVariableNumber, MultiplyVariableNumber};
+                Operand offset = operand_back(2, 0);
+                Operand constant = operand_back(1, 0);
+                drop_back(3);
+                emit(fused[last - Add], offset, constant);
+            }
+            break;
+        default:
+            break;
+    }
 }
 
-bool Function::has_return_value(const std::unique_ptr<Environment> &env) {
-    auto buffer_size = parameters.size() + variables.size();
-    return env->stack.size() > buffer_size;
+void Code::emit(Opcode op, Operand operand) {
+    emit(op);
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&operand);
+    bytecodes.insert(bytecodes.end(), bytes, bytes + sizeof(Operand));
 }
 
-void Method::print() {
-    std::cout << "Bytecodes for Method " << name << ":\n";
-    Code::print();
+void Code::emit(Opcode op, Operand first, Operand second) {
+    emit(op, first);
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&second);
+    bytecodes.insert(bytecodes.end(), bytes, bytes + sizeof(Operand));
 }
 
-void ClassStruct::print() {
-    std::cout << "Methods of Class " << name << ":\n";
-    for(auto method: methods)
-        method->print();
+Operand Code::number_constant(Value number) {
+    auto it = number_constants.find(number.raw());
+    if (it != number_constants.end())
+        return it->second;
+    constants.push_back(number);
+    return number_constants[number.raw()] = constants.size() - 1;
 }
 
-std::shared_ptr<Method> ClassStruct::find_method(std::string method_name) {
-    for (auto method: methods) {
-        if (method->name == method_name) {
-            return method;
-        }
-    }
-    std::cout << "Error: Cant find method " << method_name << " for class " << name << std::endl;
-    return NULL;
+Operand Code::void_constant() {
+    /* Void boxes to a word no number has, so it can share their pool */
+    return number_constant(Value::create_void());
 }
 
-std::shared_ptr<Method> ClassStruct::constructor() {
-    return find_method(std::string("__init__"));
+Operand Code::string_constant(const std::string &str) {
+    auto it = string_constants.find(str);
+    if (it != string_constants.end())
+        return it->second;
+    strings.emplace_back(new String(str));
+    constants.push_back(Value(strings.back().get()));
+    return string_constants[str] = constants.size() - 1;
 }
 
-void PushVariable::execute(Environment &env) {
-    Value v = env.stack[offset];
-    env.push(v);
+std::string Code::constant_to_string(Operand index) {
+    Value constant = constants[index];
+    if (constant.is_string())
+        return "\"" + constant.string()->characters() + "\"";
+    if (constant.is_int())
+        return std::to_string(constant.int_value());
+    if (constant.is_void())
+        return "Void";
+    std::ostringstream str;
+    str << constant.number();
+    return str.str();
 }
 
-void Set::execute(Environment &env) {
-    Value location = env.pop();
-    Value v = env.pop();
-    *location.location(env) = v;
+Operand Code::name_index(Symbol name) {
+    auto it = std::find(names.begin(), names.end(), name);
+    if (it != names.end())
+        return std::distance(names.begin(), it);
+    names.push_back(name);
+    return names.size() - 1;
 }
 
-void PushLValue::execute(Environment &env) {
-    env.push(Value::create_stack_lvalue(offset));
+Operand Code::function_index(std::shared_ptr<Function> function) {
+    auto it = std::find(functions.begin(), functions.end(), function);
+    if (it != functions.end())
+        return std::distance(functions.begin(), it);
+    functions.push_back(function);
+    return functions.size() - 1;
 }
 
-void ObjectAccess::execute(Environment &env) {
-    Value object = env.pop();
-    env.push(object.object(env)->find_attribute(identifier));
+Operand Code::attribute_cache(Symbol name) {
+    attribute_caches.push_back(AttributeCache(name));
+    return attribute_caches.size() - 1;
 }
 
-void ObjectAccessLValue::execute(Environment &env) {
-    Value object = env.pop();
-    env.push(Value::create_heap_lvalue(object.object(env)->find_attribute_lvalue(identifier)));
+Operand Code::method_cache(Symbol name) {
+    method_caches.push_back(MethodCache(name));
+    return method_caches.size() - 1;
 }
 
-void CallFunction::execute(Environment &env) {
-    /* Init env of called function */
-    env.child = std::unique_ptr<Environment>(new Environment());
-    env.child->parent = &env;
-    /* push parameters */
-    for (unsigned int idx_param = 0; idx_param < function->parameters.size(); idx_param++)
-        env.child->push(env.pop());
-    /* init variables on stack */
-    for(long unsigned int i = 0;i < function->variables.size(); i++)
-        env.child->stack.push_back(Value::create_void());
-    /* execute bytecode */
-    for(auto bytecode = function->bytecodes.rbegin(); bytecode != function->bytecodes.rend(); bytecode++)
-        bytecode->get()->execute(*env.child);
-    /* check for return values*/
-    if (function->has_return_value(env.child))
-        env.push(env.child->pop());
-    /* delete env of called function*/
-    env.child = NULL; 
+void Code::print_stats() {
+    for (auto &cache: attribute_caches)
+        cache.print_stats();
+    for (auto &cache: method_caches)
+        cache.print_stats();
 }
 
-void CallMethod::execute(Environment &env) {
-    std::vector<Value> parameters;
-    for(ssize_t idx_param = 0; idx_param < num_parameters; idx_param++) {
-        parameters.push_back(env.pop());
-    }
-    std::shared_ptr<Object> obj = env.pop().object(env);
-    std::shared_ptr<Method> method = obj->class_struct->find_method(name);
+void Function::print_stats() {
+    std::cout << "Inline caches of Function " << symbol_name(name) << ":\n";
+    Code::print_stats();
+}
 
-    env.child = std::unique_ptr<Environment>(new Environment());
-    env.child->parent = &env;
+void Method::print_stats() {
+    std::cout << "Inline caches of Method " << symbol_name(name) << ":\n";
+    Code::print_stats();
+}
+
+void ClassStruct::print_stats() {
+    for(auto method: methods)
+        method->print_stats();
+}
+
+Operand Code::class_index(std::shared_ptr<ClassStruct> class_struct) {
+    auto it = std::find(classes.begin(), classes.end(), class_struct);
+    if (it != classes.end())
+        return std::distance(classes.begin(), it);
+    classes.push_back(class_struct);
+    return classes.size() - 1;
+}
 
-    env.child->push(Value(obj));
-    for(auto parameter = parameters.begin(); parameter != parameters.end(); parameter++) {
-        env.child->push(*parameter);
+void Function::print() {
+    std::cout << "Bytecodes for Function " << symbol_name(name) << ":\n";
+    Code::print();
+}
+
+int Code::stack_effect(const uint8_t *ip) {
+    Opcode op = static_cast<Opcode>(*ip);
+    const uint8_t *operands = ip + 1;
+    switch (op) {
+        case CallFunction:
+        case TailCallFunction:
+            return 1 - functions[read_operand(operands)]->num_arguments();
+        case CallMethod:
+        case TailCallMethod:
+            return -static_cast<int>(read_operand(operands + sizeof(Operand)));
+        case CallBuiltin:
+            return 1 - static_cast<int>(read_operand(operands + sizeof(Operand)));
+        case BuildList:
+            return 1 - static_cast<int>(read_operand(operands));
+        case Slice:
+            return -__builtin_popcount(read_operand(operands));
+        case CallConstructor: {
+            Method *init = classes[read_operand(operands)]->constructor();
+            /* self is not pushed by the caller but returned to it */
+            return init ? 2 - init->num_arguments() : 1;
+        }
+        default:
+            return opcode_info[op].stack_effect;
     }
-    for(long unsigned int i = 0;i < method->variables.size(); i++)
-        env.child->stack.push_back(Value::create_void());
-
-    for(auto bytecode = method->bytecodes.rbegin(); bytecode != method->bytecodes.rend(); bytecode++)
-        bytecode->get()->execute(*env.child);
-    
-    if (method->has_return_value(env.child))
-        env.push(env.child->pop());
-
-    env.child = NULL; 
-}
-
-void CallConstructor::execute(Environment &env) {
-    /* Init env of called function */
-    env.child = std::unique_ptr<Environment>(new Environment());
-    env.child->parent = &env;
-    /* construct and push self object */
-    env.child->push(runtime::Value(std::shared_ptr<runtime::Object>(new runtime::Object(class_struct))));
-    /* push parameters */
-    std::shared_ptr<runtime::Method> method = class_struct->constructor();
-    for (unsigned int idx_param = 0; idx_param < method->parameters.size(); idx_param++)
-        env.child->push(env.pop());
-    /* init variables on stack */
-    for(long unsigned int i = 0;i < method->variables.size(); i++)
-        env.child->stack.push_back(Value::create_void());
-    /* execute bytecode */
-    for(auto bytecode = method->bytecodes.rbegin(); bytecode != method->bytecodes.rend(); bytecode++)
-        bytecode->get()->execute(*env.child);
-
-    /* push newly created object on stack */
-    if (env.child->is_empty()) {
-        std::cout << "Error: constructor has emptry stack!\n";
-        return;
+}
+
+void Code::finish() {
+    Opcode last = opcode_back(0);
+    if (last != Return and last != ReturnVoid and last != TailCallFunction and last != TailCallMethod)
+        emit(ReturnVoid);
+    frame_size = num_arguments() + variables.size() + temporaries;
+    int depth = 0;
+    max_stack = 0;
+    /*
+     * Loops only jump back to their ForIter and leave it forwards, so one
+     * pass sees the depth at every loop exit before reaching it. The code
+     * after a Jump is only entered through such an exit.
+     */
+    std::unordered_map<size_t, int> exit_depths;
+    for (size_t pos = 0; pos < bytecodes.size(); pos += instruction_size(static_cast<Opcode>(bytecodes[pos]))) {
+        auto exit = exit_depths.find(pos);
+        if (exit != exit_depths.end())
+            depth = exit->second;
+        /* a constructor call inserts self below the arguments first */
+        if (bytecodes[pos] == CallConstructor)
+            max_stack = std::max(max_stack, static_cast<size_t>(depth + 1));
+        /* leaving the loop drops the sequence and the position */
+        if (bytecodes[pos] == ForIter)
+            exit_depths[read_operand(&bytecodes[pos + 1])] = depth - 2;
+        depth += stack_effect(&bytecodes[pos]);
+        max_stack = std::max(max_stack, static_cast<size_t>(std::max(depth, 0)));
     }
-    Value obj = env.child->stack.front();
-    env.push(obj);
-    /* delete env of called function*/
-    env.child = NULL; 
 }
 
-void Environment::print_stack() {
-    std::cout << "Stack:\n";
-    for (auto v = stack.begin(); v != stack.end(); v++)
-        std::cout << v->to_string() << std::endl;
-}
\ No newline at end of file
+std::string Method::describe() {
+    return "Method " + symbol_name(class_struct->name) + "." + symbol_name(name);
+}
+
+void Method::print() {
+    std::cout << "Bytecodes for Method " << symbol_name(name) << ":\n";
+    Code::print();
+}
+
+void ClassStruct::print() {
+    std::cout << "Methods of Class " << symbol_name(name) << ":\n";
+    for(auto method: methods)
+        method->print();
+}
+
+void ClassStruct::add_method(std::shared_ptr<Method> method) {
+    methods.push_back(method);
+    method_table[method->name] = method.get();
+    if (symbol_name(method->name) == "__init__")
+        init = method.get();
+}
+
+Method *ClassStruct::lookup_method(Symbol method_name) {
+    auto entry = method_table.find(method_name);
+    return entry != method_table.end() ? entry->second : NULL;
+}
+
+Method *ClassStruct::find_method(Symbol method_name) {
+    if (Method *method = lookup_method(method_name))
+        return method;
+    std::cout << "Error: Cant find method " << symbol_name(method_name) << " for class " << symbol_name(name) << std::endl;
+    return NULL;
+}
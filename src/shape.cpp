@@ -0,0 +1,17 @@
+#include "runtime/shape.hpp"
+
+using namespace runtime;
+
+Shape *Shape::transition(Symbol name) {
+    auto entry = transitions.find(name);
+    if (entry != transitions.end())
+        return entry->second.get();
+    Shape *child = new Shape();
+    child->parent = this;
+    child->names = names;
+    child->names.push_back(name);
+    child->slots = slots;
+    child->slots.insert({name, names.size()});
+    transitions.insert({name, std::unique_ptr<Shape>(child)});
+    return child;
+}
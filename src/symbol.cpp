@@ -0,0 +1,16 @@
+#include "lexer/symbol.hpp"
+
+SymbolTable &SymbolTable::global() {
+    static SymbolTable table;
+    return table;
+}
+
+Symbol SymbolTable::intern(std::string_view name) {
+    auto entry = symbols.find(name);
+    if (entry != symbols.end())
+        return entry->second;
+    names.emplace_back(name);
+    Symbol symbol = names.size() - 1;
+    symbols.insert({names.back(), symbol});
+    return symbol;
+}
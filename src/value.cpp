@@ -1,31 +1,32 @@
 #include "runtime/value.hpp"
+#include "runtime/array.hpp"
+#include "runtime/heap.hpp"
 #include "runtime/environment.hpp"
 #include "runtime/code.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <string>
-#include <variant>
 
 using namespace runtime;
 
 std::string Value::to_string() const {
     std::string str;
-    switch (type) {
-        case Void: str = "Void"; break;
-        case Number: 
-            str = "Number " + std::to_string(std::get<float>(value)); 
-            break;
-        case String: 
-            str = "String " + std::get<std::string>(value);
-            break;
-        case StackLValue:
-            str = "StackLValue %" + std::get<ssize_t>(value);
-            break;
-        case HeapLValue:
-            str = "HeapLValue " + std::get<Value *>(value)->to_string();
-            break;
-        case Object:
-            str = std::get<std::shared_ptr<runtime::Object>>(value)->to_string();
+    if (is_int())
+        return "Number " + std::to_string(int_value());
+    if (is_double())
+        return "Number " + std::to_string(number());
+    switch (static_cast<Tag>((bits & TAG_MASK) >> TAG_SHIFT)) {
+        case VoidTag: str = "Void"; break;
+        case HeapTag:
+            if (is_string())
+                str = "String " + string()->characters();
+            else if (is_list())
+                str = list()->to_string();
+            else if (is_array())
+                str = static_cast<runtime::Array *>(heap_object())->to_string();
+            else
+                str = static_cast<runtime::Object *>(heap_object())->to_string();
             break;
         default:
             std::cout << "Error: Unknown type" << std::endl;
@@ -33,100 +34,215 @@ std::string Value::to_string() const {
     return str;
 }
 
-Value *Value::location(Environment &env) {
-    if (type == StackLValue) {
-        return &env.stack[std::get<ssize_t>(value)];
-    } else if(type == HeapLValue) {
-        return std::get<Value *>(value);
-    } else {
-        std::cout << "Error: lvalue is neither StackLValue nor HeapLValue\n";
+runtime::Object *Value::object() {
+    if (not is_object()) {
+        std::cout << "Error: Trying to access attribute of " << to_string() << std::endl;
+        return NULL;
     }
-    return NULL;
+    return static_cast<runtime::Object *>(heap_object());
 }
 
-Value Value::create_stack_lvalue(ssize_t offset) {
-    return Value(offset, StackLValue);
-}
-
-Value Value::create_heap_lvalue(Value *pointer) {
-    return Value(pointer, HeapLValue);
-}
-
-std::shared_ptr<Object> Value::object(Environment &env) {
-    if (type == StackLValue or type == HeapLValue) {
-        Value *value = location(env);
-        return value->object(env);
-    }
-    if (type != Value::Object) {
-        std::cout << "Error: Trying to access attribute of " << to_string() << std::endl;
+runtime::Array *Value::array() {
+    if (not is_array()) {
+        std::cout << "Error: Trying to index " << to_string() << std::endl;
         return NULL;
     }
-    return std::get<std::shared_ptr<runtime::Object>>(value);
+    return static_cast<runtime::Array *>(heap_object());
 }
 
-Value Value::add(const Value &a, const Value &b) {
-    if (a.type == Number and b.type == Number)
-        return Value(std::get<float>(a.value) + std::get<float>(b.value));
-    if (a.type == String and b.type == String)
-        return Value(std::get<std::string>(a.value) + std::get<std::string>(b.value));
+Value Value::add(Heap &heap, const Value &a, const Value &b) {
+    if (a.is_int() and b.is_int())
+        return create_int(a.int_value() + b.int_value());
+    if (a.is_number() and b.is_number())
+        return Value(a.number() + b.number());
+    if (a.is_string() and b.is_string())
+        return Value(runtime::String::concat(heap, a.string(), b.string()));
     std::cout << "Error: trying to add " << a.to_string() << " and " << b.to_string() << std::endl;
     return Value::create_void();
 }
 
 Value Value::minus(const Value &a, const Value &b) {
-    if (a.type == Number and b.type == Number)
-        return Value(std::get<float>(a.value) - std::get<float>(b.value));
+    if (a.is_int() and b.is_int())
+        return create_int(a.int_value() - b.int_value());
+    if (a.is_number() and b.is_number())
+        return Value(a.number() - b.number());
     std::cout << "Error: trying to minus " << a.to_string() << " and " << b.to_string() << std::endl;
     return Value::create_void();
 }
 
+/* true division, ints give a double like in python */
 Value Value::div(const Value &a, const Value &b) {
-    if (a.type == Number and b.type == Number)
-        return Value(std::get<float>(a.value) / std::get<float>(b.value));
+    if (a.is_number() and b.is_number())
+        return Value(a.number() / b.number());
     std::cout << "Error: trying to divide " << a.to_string() << " and " << b.to_string() << std::endl;
     return Value::create_void();
 }
 
 Value Value::mul(const Value &a, const Value &b) {
-    if (a.type == Number and b.type == Number)
-        return Value(std::get<float>(a.value) * std::get<float>(b.value));
+    int64_t product;
+    if (a.is_int() and b.is_int() and !__builtin_mul_overflow(a.int_value(), b.int_value(), &product))
+        return create_int(product);
+    if (a.is_number() and b.is_number())
+        return Value(a.number() * b.number());
     std::cout << "Error: trying to multiply " << a.to_string() << " and " << b.to_string() << std::endl;
     return Value::create_void();
 }
 
+Value Value::negate(const Value &a) {
+    if (a.is_int())
+        return create_int(-a.int_value());
+    if (a.is_double())
+        return Value(-a.number());
+    std::cout << "Error: trying to negate " << a.to_string() << std::endl;
+    return Value::create_void();
+}
+
+/* clamps a slice bound into [0, length] like python, negative bounds count from the end */
+static bool slice_bound(const Value &bound, int64_t length, int64_t omitted, int64_t &position) {
+    if (bound.is_void()) {
+        position = omitted;
+        return true;
+    }
+    if (!bound.is_int()) {
+        std::cout << "Error: slice bound " << bound.to_string() << " is no int" << std::endl;
+        return false;
+    }
+    position = bound.int_value();
+    if (position < 0)
+        position += length;
+    position = std::clamp(position, static_cast<int64_t>(0), length);
+    return true;
+}
+
+Value Value::slice(Heap &heap, const Value &sequence, const Value &start, const Value &stop) {
+    if (!sequence.is_list() and !sequence.is_array()) {
+        std::cout << "Error: trying to slice " << sequence.to_string() << std::endl;
+        return Value::create_void();
+    }
+    runtime::Array *array = sequence.is_array() ? static_cast<runtime::Array *>(sequence.heap_object()) : NULL;
+    int64_t length = array ? array->length() : sequence.list()->elements.size();
+    int64_t first, last;
+    if (!slice_bound(start, length, 0, first) or !slice_bound(stop, length, length, last))
+        return Value::create_void();
+    last = std::max(first, last);
+    if (array == NULL) {
+        auto &elements = sequence.list()->elements;
+        return Value(heap.allocate<runtime::List>(std::vector<Value>(elements.begin() + first, elements.begin() + last)));
+    }
+    runtime::Array *copy = heap.allocate<runtime::Array>(array->type, last - first);
+    if (array->type == runtime::Array::Float64)
+        std::copy(array->doubles.begin() + first, array->doubles.begin() + last, copy->doubles.begin());
+    else
+        std::copy(array->ints.begin() + first, array->ints.begin() + last, copy->ints.begin());
+    return Value(copy);
+}
+
+runtime::String *runtime::String::concat(Heap &heap, String *left, String *right) {
+    if (left->length + right->length < ROPE_MIN_LENGTH)
+        return heap.allocate<String>(left->flat(heap) + right->flat(heap));
+    return heap.allocate<String>(left, right);
+}
+
+const std::string &runtime::String::flat(Heap &heap) {
+    if (!is_rope())
+        return value;
+    value = characters();
+    left = right = NULL;
+    heap.grew(value.capacity());
+    return value;
+}
+
+std::string runtime::String::characters() const {
+    if (!is_rope())
+        return value;
+    /* walk the pieces left to right without recursing, ropes can be deep */
+    std::string characters;
+    characters.reserve(length);
+    std::vector<String *> pending{right, left};
+    while (!pending.empty()) {
+        String *piece = pending.back();
+        pending.pop_back();
+        if (piece->is_rope()) {
+            pending.push_back(piece->right);
+            pending.push_back(piece->left);
+        } else
+            characters += piece->value;
+    }
+    return characters;
+}
+
+void runtime::String::trace(Heap &heap) {
+    if (is_rope()) {
+        heap.mark(left);
+        heap.mark(right);
+    }
+}
+
+size_t runtime::List::append(Value value) {
+    size_t capacity = elements.capacity();
+    elements.push_back(value);
+    return (elements.capacity() - capacity) * sizeof(Value);
+}
+
+std::string runtime::List::to_string() const {
+    std::string str = "[";
+    for (size_t index = 0; index < elements.size(); index++) {
+        if (index)
+            str += ", ";
+        str += elements[index].to_string();
+    }
+    str += "]";
+    return str;
+}
+
+void runtime::List::trace(Heap &heap) {
+    for (Value &element: elements)
+        heap.mark(element);
+}
+
 Value Value::create_void() {
-    return Value(0.0f, Void);
+    return Value(VoidTag, 0);
 }
 
 
-Value runtime::Object::find_attribute(std::string name) {
-    auto entry = attributes.find(name);
-    if (entry != attributes.end())
-        return entry->second;
+runtime::Object::Object(ClassStruct *class_) : HeapObject(HeapObject::Object), class_struct(class_), shape(&class_->root_shape) {}
+
+Value runtime::Object::find_attribute(Symbol name) {
+    size_t slot = shape->lookup(name);
+    if (slot != Shape::NOT_FOUND)
+        return slots[slot];
     return Value::create_void();
 }
 
-
-Value *runtime::Object::find_attribute_lvalue(std::string name) {
-   auto entry = attributes.find(name);
-    if (entry != attributes.end())
-        return &entry->second;
-    auto result = attributes.insert({name, Value::create_void()});
-    if (result.second) {
-        return &result.first->second;
+size_t runtime::Object::set_attribute(Symbol name, Value value) {
+    size_t slot = shape->lookup(name);
+    if (slot != Shape::NOT_FOUND) {
+        slots[slot] = value;
+        return 0;
     }
-    std::cout << "Error: failed to insert entry for " << name << " into object\n";
-    return NULL;
+    shape = shape->transition(name);
+    return add_slot(value);
+}
+
+size_t runtime::Object::add_slot(Value value) {
+    size_t capacity = slots.capacity();
+    slots.push_back(value);
+    return (slots.capacity() - capacity) * sizeof(Value);
+}
+
+void runtime::Object::trace(Heap &heap) {
+    for (Value &slot: slots)
+        heap.mark(slot);
 }
 
 std::string runtime::Object::to_string() const {
-    std::string str = class_struct->name +  "(";
-    for (auto it = attributes.begin(); it != attributes.end(); it++) {
-        str += it->first + "=" + it->second.to_string();
-        if (std::next(it) != attributes.end()) {
+    std::string str = symbol_name(class_struct->name) +  "(";
+    for (size_t slot = 0; slot < slots.size(); slot++) {
+        str += symbol_name(shape->names[slot]) + "=" + slots[slot].to_string();
+        if (slot + 1 != slots.size()) {
             str += ", ";
         }
     }
     str += ")";
     return str;
-}
\ No newline at end of file
+}